@@ -22,13 +22,21 @@ namespace mpe
 		AutoMPE() :
 			buffer(),
 			voices(),
-			channelIdx(0)
+			channelIdx(0),
+			numStolen(0)
 		{
 		}
 
+		// reserves room for numBytes of midi, so that processing doesn't allocate
+		void prepare(int numBytes)
+		{
+			buffer.ensureSize(static_cast<size_t>(numBytes));
+		}
+
 		void operator()(MidiBuffer& midiMessages)
 		{
 			buffer.clear();
+			numStolen = 0;
 			for(const auto it : midiMessages)
 			{
 				auto msg = it.getMessage();
@@ -43,10 +51,16 @@ namespace mpe
 			midiMessages.swapWith(buffer);
 		}
 
+		// voices stolen by the last call, because all channels were playing
+		int getNumStolen() const noexcept
+		{
+			return numStolen;
+		}
+
 	private:
 		MidiBuffer buffer;
 		Voices voices;
-		int channelIdx;
+		int channelIdx, numStolen;
 
 		void incChannel() noexcept
 		{
@@ -63,6 +77,7 @@ namespace mpe
 					return processNoteOn(voice, msg);
 			}
 			incChannel();
+			++numStolen;
 			auto& voice = voices[channelIdx];
 			buffer.addEvent(MidiMessage::noteOff(voice.channel, voice.note), ts);
 			processNoteOn(voice, msg);
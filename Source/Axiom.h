@@ -3,5 +3,8 @@
 namespace axiom
 {
 	static constexpr int MinXen = 3;
-	static constexpr int MaxXen = 48;
+	static constexpr int MaxXen = 311;
+	// the top of the xen range before multi channel tables, the middle of its normalised range
+	static constexpr int OldMaxXen = 48;
+	static constexpr int MaxScales = 4096;
 }
\ No newline at end of file
@@ -13,6 +13,13 @@ namespace mpe
 		{
 		}
 
+		// reserves room for numBytes of midi per channel, so that processing doesn't allocate
+		void prepare(int numBytes)
+		{
+			for (auto& buffer : buffers)
+				buffer.ensureSize(static_cast<size_t>(numBytes));
+		}
+
 		void operator()(MidiBuffer& midiIn)
 		{
 			for (auto& buffer : buffers)
@@ -0,0 +1,135 @@
+#pragma once
+#include <juce_events/juce_events.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "mts/Master/libMTSMaster.h"
+
+namespace xen
+{
+	// process-wide owner of the mts-esp master registration, shared by all xen instances
+	// through a SharedResourcePointer. activated instances queue up, the first one
+	// registers and the next one takes over as soon as it deactivates. only while a
+	// master outside of this process holds the registration, it is retried on a timer.
+	struct MTSMaster :
+		public juce::Timer
+	{
+		static constexpr int RetryIntervalMs = 1000;
+
+		enum class State
+		{
+			// no instance is activated
+			Idle,
+			// an activated instance is master
+			Registered,
+			// another master holds the registration
+			Blocked,
+			// blocked, but libMTS has ipc, so the other master might be left over from a crash
+			BlockedIPC
+		};
+
+		struct Listener
+		{
+			virtual ~Listener() = default;
+
+			// called with the registry locked, must not call back into it
+			virtual void masterChanged(bool isMaster) noexcept = 0;
+		};
+
+		MTSMaster() :
+			Timer(),
+			mutex(),
+			candidates(),
+			owner(nullptr),
+			state(State::Idle)
+		{}
+
+		~MTSMaster() override
+		{
+			stopTimer();
+			if (owner != nullptr)
+				MTS_DeregisterMaster();
+		}
+
+		// registers the listener as master, or queues it up behind the current one
+		void activate(Listener* listener)
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			if (std::find(candidates.begin(), candidates.end(), listener) != candidates.end())
+				return;
+			candidates.push_back(listener);
+			if (owner == nullptr)
+				tryRegister();
+		}
+
+		// hands the registration off to the next activated instance right away
+		void deactivate(Listener* listener)
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			candidates.erase(std::remove(candidates.begin(), candidates.end(), listener), candidates.end());
+			if (owner != listener)
+				return;
+			MTS_DeregisterMaster();
+			owner = nullptr;
+			listener->masterChanged(false);
+			tryRegister();
+		}
+
+		State getState() const
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			return state;
+		}
+
+		// as libMTSMaster.h advises, only for when the user confirmed that the other
+		// master is left over from a crash. true if an instance is master afterwards
+		bool reinitialize()
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			if (state != State::BlockedIPC || candidates.empty())
+				return false;
+			MTS_Reinitialize();
+			registerMaster(candidates.front());
+			return true;
+		}
+
+		void timerCallback() override
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			if (owner == nullptr)
+				tryRegister();
+		}
+
+	private:
+		mutable std::mutex mutex;
+		std::vector<Listener*> candidates;
+		Listener* owner;
+		State state;
+
+		void tryRegister()
+		{
+			if (candidates.empty())
+			{
+				state = State::Idle;
+				return stopTimer();
+			}
+			if (!MTS_CanRegisterMaster())
+			{
+				state = MTS_HasIPC() ? State::BlockedIPC : State::Blocked;
+				if (!isTimerRunning())
+					startTimer(RetryIntervalMs);
+				return;
+			}
+			registerMaster(candidates.front());
+		}
+
+		void registerMaster(Listener* listener)
+		{
+			MTS_RegisterMaster();
+			owner = listener;
+			state = State::Registered;
+			stopTimer();
+			listener->masterChanged(true);
+		}
+	};
+}
\ No newline at end of file
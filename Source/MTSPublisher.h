@@ -0,0 +1,153 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <cstring>
+#include "mts/Master/libMTSMaster.h"
+
+namespace xen
+{
+	// remembers what has been sent to MTS-ESP, so that only changed notes and
+	// scale infos get published again. every call fans out to all connected clients.
+	struct MTSPublisher
+	{
+		static constexpr int NumPitches = 128;
+		static constexpr int NumChannels = 16;
+		// more changed notes than this are sent as one table
+		static constexpr int BulkThreshold = 16;
+		// longer scale names are cut off
+		static constexpr int NameSize = 64;
+
+		MTSPublisher() :
+			table(),
+			channelTables(),
+			channelsUsed(),
+			periodRatio(0.),
+			mapSize(0),
+			refKey(0),
+			mapStartKey(0),
+			name(),
+			valid(false)
+		{}
+
+		// forces the next publish to send everything, e.g. after (re)registering as master
+		void invalidate() noexcept
+		{
+			valid.store(false);
+		}
+
+		bool isValid() const noexcept
+		{
+			return valid.load();
+		}
+
+		// freqTable, channelTables, numChannels, periodRatio, mapSize, refKey, mapStartKey, name
+		// channels [0, numChannels[ are part of the multi-channel table, the others are released.
+		// returns how many notes were left out because their tuning didn't change
+		int operator()(const double* freqTable, const double (*_channelTables)[NumPitches], int numChannels,
+			double _periodRatio, char _mapSize, char _refKey, char _mapStartKey, const char* _name)
+		{
+			const auto force = !valid.exchange(true);
+			auto numUnchanged = publishNotes(table, freqTable, force,
+				[](const double* freqs)
+				{
+					MTS_SetNoteTunings(freqs);
+				},
+				[](double freq, char note)
+				{
+					MTS_SetNoteTuning(freq, note);
+				});
+			for (auto ch = 0; ch < NumChannels; ++ch)
+				numUnchanged += publishChannel(_channelTables[ch], ch, ch < numChannels, force);
+			if (force || periodRatio != _periodRatio)
+			{
+				periodRatio = _periodRatio;
+				MTS_SetPeriodRatio(periodRatio);
+			}
+			if (force || mapSize != _mapSize)
+			{
+				mapSize = _mapSize;
+				MTS_SetMapSize(mapSize);
+			}
+			if (force || refKey != _refKey)
+			{
+				refKey = _refKey;
+				MTS_SetRefKey(refKey);
+			}
+			if (force || mapStartKey != _mapStartKey)
+			{
+				mapStartKey = _mapStartKey;
+				MTS_SetMapStartKey(mapStartKey);
+			}
+			if (force || std::strncmp(name, _name, NameSize - 1) != 0)
+			{
+				std::strncpy(name, _name, NameSize - 1);
+				name[NameSize - 1] = '\0';
+				MTS_SetScaleName(name);
+			}
+			return numUnchanged;
+		}
+
+	private:
+		double table[NumPitches];
+		double channelTables[NumChannels][NumPitches];
+		bool channelsUsed[NumChannels];
+		double periodRatio;
+		char mapSize, refKey, mapStartKey;
+		char name[NameSize];
+		std::atomic<bool> valid;
+
+		int publishChannel(const double* freqTable, int ch, bool used, bool force)
+		{
+			const auto midiChannel = static_cast<char>(ch);
+			if (force || channelsUsed[ch] != used)
+			{
+				channelsUsed[ch] = used;
+				MTS_SetMultiChannel(used, midiChannel);
+				force = true;
+			}
+			if (!used)
+				return 0;
+			return publishNotes(channelTables[ch], freqTable, force,
+				[midiChannel](const double* freqs)
+				{
+					MTS_SetMultiChannelNoteTunings(freqs, midiChannel);
+				},
+				[midiChannel](double freq, char note)
+				{
+					MTS_SetMultiChannelNoteTuning(freq, note, midiChannel);
+				});
+		}
+
+		// published, freqTable, force, setAll, setOne
+		// returns the number of unchanged notes that weren't sent
+		template<typename SetAll, typename SetOne>
+		static int publishNotes(double* published, const double* freqTable, bool force,
+			const SetAll& setAll, const SetOne& setOne)
+		{
+			auto numChanged = 0;
+			if (!force)
+				for (auto i = 0; i < NumPitches; ++i)
+					if (published[i] != freqTable[i])
+						++numChanged;
+
+			if (force || numChanged > BulkThreshold)
+			{
+				for (auto i = 0; i < NumPitches; ++i)
+					published[i] = freqTable[i];
+				setAll(published);
+				return 0;
+			}
+
+			const auto numUnchanged = NumPitches - numChanged;
+
+			for (auto i = 0; i < NumPitches && numChanged > 0; ++i)
+				if (published[i] != freqTable[i])
+				{
+					published[i] = freqTable[i];
+					setOne(published[i], static_cast<char>(i));
+					--numChanged;
+				}
+			return numUnchanged;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,246 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace xen
+{
+	// turns tuning tables into midi tuning standard sysex, for synths without mts-esp.
+	// every table is compiled into note data and a bulk dump once and cached,
+	// so emitting one is a memcpy. after the first dump only the notes that changed
+	// are sent as real-time single note changes, to stay within hardware midi bandwidth.
+	// messages are held back while they would exceed the bandwidth of a din midi cable,
+	// the next compile replaces a held back message, so the receiver skips to the newest tuning.
+	struct MTSSysex
+	{
+		static constexpr int NumPitches = 128;
+		static constexpr int CacheSize = 16;
+		// characters of the name in a bulk dump
+		static constexpr int NameSize = 16;
+		// F0 7E 7F 08 01 prog, name, 3 bytes per note, checksum, F7
+		static constexpr int BulkSize = 6 + NameSize + 3 * NumPitches + 2;
+		// F0 7F 7F 08 02 prog count, 4 bytes per note, F7
+		static constexpr int SingleNoteHeaderSize = 7;
+		// beyond this many changed notes a bulk dump is smaller
+		static constexpr int MaxSingleNoteChanges = (BulkSize - SingleNoteHeaderSize - 1) / 4;
+		static constexpr int MaxSingleNoteSize = SingleNoteHeaderSize + 4 * MaxSingleNoteChanges + 1;
+		// din midi: 31250 baud, 10 bits per byte
+		static constexpr double MaxBytesPerSecond = 3125.;
+		using Byte = juce::uint8;
+		using Data = std::array<Byte, 3 * NumPitches>;
+		using Midi = juce::MidiBuffer;
+
+		MTSSysex() :
+			cache(),
+			numCached(0),
+			nextSlot(0),
+			sentData(),
+			pendingData(),
+			singleNote(),
+			pending(nullptr),
+			pendingSize(0),
+			out(),
+			bytesPerSample(0.),
+			credit(static_cast<double>(BulkSize)),
+			valid(false)
+		{
+			out.ensureSize(4 * BulkSize);
+		}
+
+		// sampleRate
+		void prepare(double sampleRate) noexcept
+		{
+			bytesPerSample = MaxBytesPerSecond / sampleRate;
+			credit = static_cast<double>(BulkSize);
+		}
+
+		// the next compiled table goes out as a bulk dump
+		void invalidate() noexcept
+		{
+			valid = false;
+		}
+
+		bool isValid() const noexcept
+		{
+			return valid;
+		}
+
+		// table, name
+		// prepares the message that gets the receiver from the last emitted tuning to this one
+		void compile(const double* table, const char* name)
+		{
+			const auto& tuning = getTuning(table, name);
+			pendingData = tuning.data;
+			if (!valid)
+			{
+				valid = true;
+				pending = tuning.bulk.data();
+				pendingSize = BulkSize;
+				return;
+			}
+
+			auto numChanged = 0;
+			for (auto i = 0; i < NumPitches; ++i)
+				if (std::memcmp(&sentData[3 * i], &tuning.data[3 * i], 3) != 0)
+					++numChanged;
+
+			if (numChanged == 0)
+			{
+				pending = nullptr;
+				return;
+			}
+			if (numChanged > MaxSingleNoteChanges)
+			{
+				pending = tuning.bulk.data();
+				pendingSize = BulkSize;
+				return;
+			}
+
+			auto d = singleNote.data();
+			*d++ = 0xf0; *d++ = 0x7f; *d++ = 0x7f; *d++ = 0x08; *d++ = 0x02;
+			*d++ = 0x00;
+			*d++ = static_cast<Byte>(numChanged);
+			for (auto i = 0; i < NumPitches; ++i)
+				if (std::memcmp(&sentData[3 * i], &tuning.data[3 * i], 3) != 0)
+				{
+					*d++ = static_cast<Byte>(i);
+					std::memcpy(d, &tuning.data[3 * i], 3);
+					d += 3;
+				}
+			*d++ = 0xf7;
+			pending = singleNote.data();
+			pendingSize = static_cast<int>(d - singleNote.data());
+		}
+
+		void begin() noexcept
+		{
+			out.clear();
+		}
+
+		// adds the pending message, if any, at ts, once the bandwidth allows it
+		void emit(int ts)
+		{
+			if (pending == nullptr || credit < static_cast<double>(pendingSize))
+				return;
+			credit -= static_cast<double>(pendingSize);
+			out.addEvent(pending, pendingSize, ts);
+			sentData = pendingData;
+			pending = nullptr;
+		}
+
+		// numSamples
+		// at most one bulk dump can be sent at once after a pause
+		void advance(int numSamples) noexcept
+		{
+			credit = juce::jmin(credit + static_cast<double>(numSamples) * bytesPerSample, static_cast<double>(BulkSize));
+		}
+
+		void end(Midi& midi, int numSamples)
+		{
+			midi.addEvents(out, 0, numSamples, 0);
+		}
+
+	private:
+		struct Tuning
+		{
+			Tuning() :
+				table(),
+				name(),
+				data(),
+				bulk()
+			{}
+
+			std::array<double, NumPitches> table;
+			// only what fits the bulk dump, so it never allocates
+			std::array<char, NameSize + 1> name;
+			Data data;
+			std::array<Byte, BulkSize> bulk;
+		};
+
+		std::array<Tuning, CacheSize> cache;
+		int numCached, nextSlot;
+		Data sentData, pendingData;
+		std::array<Byte, MaxSingleNoteSize> singleNote;
+		const Byte* pending;
+		int pendingSize;
+		Midi out;
+		// bytes that can be sent now
+		double bytesPerSample, credit;
+		bool valid;
+
+		// table, name
+		const Tuning& getTuning(const double* table, const char* name)
+		{
+			const auto tableSize = NumPitches * sizeof(double);
+			for (auto i = 0; i < numCached; ++i)
+			{
+				const auto& tuning = cache[i];
+				if (std::memcmp(tuning.table.data(), table, tableSize) == 0 &&
+					std::strncmp(tuning.name.data(), name, NameSize) == 0)
+					return tuning;
+			}
+
+			auto& tuning = cache[nextSlot];
+			nextSlot = (nextSlot + 1) % CacheSize;
+			numCached = juce::jmin(numCached + 1, CacheSize);
+			std::memcpy(tuning.table.data(), table, tableSize);
+			std::strncpy(tuning.name.data(), name, NameSize);
+			tuning.name[NameSize] = '\0';
+			for (auto i = 0; i < NumPitches; ++i)
+				quantize(table[i], &tuning.data[3 * i]);
+			compileBulk(tuning);
+			return tuning;
+		}
+
+		static void compileBulk(Tuning& tuning) noexcept
+		{
+			auto d = tuning.bulk.data();
+			*d++ = 0xf0; *d++ = 0x7e; *d++ = 0x7f; *d++ = 0x08; *d++ = 0x01;
+			*d++ = 0x00;
+			const auto name = tuning.name.data();
+			auto nameEnded = false;
+			for (auto i = 0; i < NameSize; ++i)
+			{
+				nameEnded = nameEnded || name[i] == '\0';
+				const auto c = nameEnded ? ' ' : name[i];
+				*d++ = static_cast<Byte>(c >= ' ' && c < 0x7f ? c : '?');
+			}
+			std::memcpy(d, tuning.data.data(), tuning.data.size());
+			d += tuning.data.size();
+			Byte checksum = 0;
+			for (auto b = tuning.bulk.data() + 1; b < d; ++b)
+				checksum ^= *b;
+			*d++ = checksum & 0x7f;
+			*d = 0xf7;
+		}
+
+		// freq, data
+		// semitone and 14 bit fraction above it
+		static void quantize(double freq, Byte* data) noexcept
+		{
+			const auto semis = 69. + 12. * std::log2(freq / 440.);
+			if (!(semis > 0.))
+			{
+				data[0] = data[1] = data[2] = 0;
+				return;
+			}
+			auto note = static_cast<int>(semis);
+			auto frac = static_cast<int>(std::round((semis - static_cast<double>(note)) * 16384.));
+			if (frac == 16384)
+			{
+				++note;
+				frac = 0;
+			}
+			// 7F 7F 7F means no change
+			if (note > 127 || (note == 127 && frac > 16382))
+			{
+				note = 127;
+				frac = 16382;
+			}
+			data[0] = static_cast<Byte>(note);
+			data[1] = static_cast<Byte>(frac >> 7);
+			data[2] = static_cast<Byte>(frac & 0x7f);
+		}
+	};
+}
\ No newline at end of file
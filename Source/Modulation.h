@@ -0,0 +1,113 @@
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <cmath>
+#include "Math.h"
+
+namespace mod
+{
+	using MidiBuffer = juce::MidiBuffer;
+
+	enum class Type { Off, LFO, Steps, CC, NumTypes };
+
+	// bipolar [-1, 1] modulation source, advanced once per control tick
+	struct Modulator
+	{
+		static constexpr int NumSteps = 8;
+		// smoothing of the cc follower
+		static constexpr double CCSmoothHz = 8.;
+
+		Modulator() :
+			steps(),
+			type(Type::Off),
+			phase(0.),
+			inc(0.),
+			rateHz(0.),
+			controlRate(1.),
+			ccValue(0.),
+			ccTarget(0.),
+			ccSmooth(1.),
+			ccNumber(1)
+		{}
+
+		void prepare(double _controlRate) noexcept
+		{
+			controlRate = _controlRate;
+			ccSmooth = 1. - std::exp(-math::Tau * CCSmoothHz / controlRate);
+			setRate(rateHz);
+		}
+
+		bool isActive() const noexcept
+		{
+			return type != Type::Off;
+		}
+
+		void setType(Type _type) noexcept
+		{
+			if (type == _type)
+				return;
+			type = _type;
+			phase = 0.;
+		}
+
+		// lfo: cycles per second, steps: steps per second
+		void setRate(double hz) noexcept
+		{
+			rateHz = hz;
+			inc = rateHz / controlRate;
+		}
+
+		void setCC(int number) noexcept
+		{
+			ccNumber = number;
+		}
+
+		// step index, value [-1, 1]
+		void setStep(int i, double value) noexcept
+		{
+			steps[i] = value;
+		}
+
+		// remembers the latest value of the followed cc
+		void processMidi(const MidiBuffer& midi) noexcept
+		{
+			if (type != Type::CC)
+				return;
+			for (const auto it : midi)
+			{
+				const auto msg = it.getMessage();
+				if (msg.isControllerOfType(ccNumber))
+					ccTarget = static_cast<double>(msg.getControllerValue()) / 63.5 - 1.;
+			}
+		}
+
+		double operator()() noexcept
+		{
+			switch (type)
+			{
+			case Type::LFO:
+				phase += inc;
+				phase -= std::floor(phase);
+				return std::sin(math::Tau * phase);
+			case Type::Steps:
+			{
+				phase += inc;
+				phase -= std::floor(phase / NumSteps) * NumSteps;
+				const auto idx = juce::jlimit(0, NumSteps - 1, static_cast<int>(phase));
+				return steps[idx];
+			}
+			case Type::CC:
+				ccValue += ccSmooth * (ccTarget - ccValue);
+				return ccValue;
+			default:
+				return 0.;
+			}
+		}
+
+	private:
+		std::array<double, NumSteps> steps;
+		Type type;
+		double phase, inc, rateHz, controlRate, ccValue, ccTarget, ccSmooth;
+		int ccNumber;
+	};
+}
\ No newline at end of file
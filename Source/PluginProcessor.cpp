@@ -1,6 +1,7 @@
 #include "PluginProcessor.h"
 #include "Axiom.h"
 #include "Range.h"
+#include <chrono>
 
 juce::AudioProcessorValueTreeState::ParameterLayout XenAudioProcessor::createParameters()
 {
@@ -15,11 +16,6 @@ juce::AudioProcessorValueTreeState::ParameterLayout XenAudioProcessor::createPar
             return s.getIntValue() != 0;
         };
 
-    const auto valToStrMode = [](bool e, int)
-    {
-        return juce::String(e ? "MTS-ESP" : "MPE");
-    };
-
     const auto valToStrPitch = [](int note, int)
 	{
         return juce::MidiMessage::getMidiNoteName(note, true, true, 3) + " [" + juce::String(note) + "]";
@@ -53,6 +49,29 @@ juce::AudioProcessorValueTreeState::ParameterLayout XenAudioProcessor::createPar
         return juce::String(semi) + " semi";
     };
 
+    const auto valToStrHz = [](float hz, int)
+    {
+        return juce::String(hz, 2) + "hz";
+    };
+
+    const auto valToStrSteps = [](float steps, int)
+    {
+        return juce::String(steps, 2) + " steps";
+    };
+
+    const auto valToStrSemiF = [](float semi, int)
+    {
+        return juce::String(semi, 2) + " semi";
+    };
+
+    const auto valToStrScale = [library = scaleLibrary](int idx, int)
+    {
+        if (idx == 0)
+            return juce::String("Off");
+        const auto name = library->getName(idx - 1);
+        return name.isEmpty() ? juce::String(idx) : name;
+    };
+
     const auto atr = juce::AudioParameterBoolAttributes();
     params.push_back(std::make_unique<juce::AudioParameterBool>
     (
@@ -61,17 +80,23 @@ juce::AudioProcessorValueTreeState::ParameterLayout XenAudioProcessor::createPar
 	const auto atrXen = juce::AudioParameterFloatAttributes().withStringFromValueFunction(valToStrXen);
 	const auto xenMinF = static_cast<float>(axiom::MinXen);
 	const auto xenMaxF = static_cast<float>(axiom::MaxXen);
-	const auto xenRange = xenMaxF - xenMinF;
+	// piecewise linear: the lower half covers 3 to 48 tet, the range before large edos,
+	// the upper half 48 to 311. automation from then maps to half its normalised value
+	const auto xenMidF = static_cast<float>(axiom::OldMaxXen);
     const auto xenNormRange = juce::NormalisableRange<float>
     (
 		xenMinF, xenMaxF,
-        [xenRange](float start, float, float x)
+        [xenMidF](float start, float end, float x)
         {
-            return start + xenRange * x;
+            if (x < .5f)
+                return start + (xenMidF - start) * x * 2.f;
+            return xenMidF + (end - xenMidF) * (x - .5f) * 2.f;
         },
-        [xenRange](float start, float, float x)
+        [xenMidF](float start, float end, float x)
         {
-            return (x - start) / xenRange;
+            if (x < xenMidF)
+                return (x - start) / (xenMidF - start) * .5f;
+            return .5f + (x - xenMidF) / (end - xenMidF) * .5f;
         },
         [&](float start, float end, float x)
         {
@@ -97,17 +122,86 @@ juce::AudioProcessorValueTreeState::ParameterLayout XenAudioProcessor::createPar
     (
         "stepsIn12", "Steps In 12", false, atr
     ));
-    const auto atrMode = juce::AudioParameterBoolAttributes().withStringFromValueFunction(valToStrMode);
-    params.push_back(std::make_unique<juce::AudioParameterBool>
+    // mts-esp is last, so automation from when this was a bool (0 mpe, 1 mts-esp) keeps its meaning.
+    // xml sessions store the index, which restoring migrates from the order mpe, mts-esp, sysex
+    params.push_back(std::make_unique<juce::AudioParameterChoice>
     (
-        "mode", "Mode", true, atrMode
+        "mode", "Mode", juce::StringArray{ "MPE", "MTS SysEx", "MTS-ESP" }, 2
     ));
     const auto atrPBRange = juce::AudioParameterIntAttributes().withStringFromValueFunction(valToStrSemi);
     params.push_back(std::make_unique<juce::AudioParameterInt>
     (
         "pbrange", "Pitchbend Range", 1, 48, 48, atrPBRange
     ));
-    return { params.begin(), params.end() };
+    const auto atrScale = juce::AudioParameterIntAttributes().withStringFromValueFunction(valToStrScale);
+    params.push_back(std::make_unique<juce::AudioParameterInt>
+    (
+        "scale", "Scale", 0, axiom::MaxScales, 0, atrScale
+    ));
+    params.push_back(std::make_unique<juce::AudioParameterBool>
+    (
+        "multichannel", "Multi Channel", false, atr
+    ));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>
+    (
+        "modtype", "Mod Type", juce::StringArray{ "Off", "LFO", "Steps", "CC" }, 0
+    ));
+    const auto atrModRate = juce::AudioParameterFloatAttributes().withStringFromValueFunction(valToStrHz);
+    params.push_back(std::make_unique<juce::AudioParameterFloat>
+    (
+        "modrate", "Mod Rate", makeRange::withCentre(.05f, 20.f, 1.f), 1.f, atrModRate
+    ));
+    const auto atrModXen = juce::AudioParameterFloatAttributes().withStringFromValueFunction(valToStrSteps);
+    params.push_back(std::make_unique<juce::AudioParameterFloat>
+    (
+        "modxen", "Mod Xen", makeRange::lin(-12.f, 12.f), 0.f, atrModXen
+    ));
+    const auto atrModAnchor = juce::AudioParameterFloatAttributes().withStringFromValueFunction(valToStrSemiF);
+    params.push_back(std::make_unique<juce::AudioParameterFloat>
+    (
+        "modanchor", "Mod Anchor", makeRange::lin(-12.f, 12.f), 0.f, atrModAnchor
+    ));
+    params.push_back(std::make_unique<juce::AudioParameterInt>
+    (
+        "modcc", "Mod CC", 0, 127, 1
+    ));
+    for (auto i = 0; i < mod::Modulator::NumSteps; ++i)
+    {
+        const auto id = "modstep" + juce::String(i + 1);
+        const auto name = "Mod Step " + juce::String(i + 1);
+        params.push_back(std::make_unique<juce::AudioParameterFloat>
+        (
+            id, name, makeRange::lin(-1.f, 1.f), 0.f
+        ));
+    }
+    juce::AudioProcessorValueTreeState::ParameterLayout layout(params.begin(), params.end());
+
+    auto statsGroup = std::make_unique<juce::AudioProcessorParameterGroup>("stats", "Stats", "|");
+    const auto atrStats = juce::AudioParameterFloatAttributes()
+        .withCategory(juce::AudioProcessorParameter::otherMeter)
+        .withAutomatable(false);
+    for (auto i = 0; i < NumStatsParameters; ++i)
+    {
+        const auto name = i < stats::NumCounters ?
+            juce::String(stats::getName(static_cast<stats::Counter>(i))) :
+            i == QualityTierParameter ? juce::String("quality tier") :
+            juce::String(i == stats::NumCounters ? "block p50 us" : "block p99 us");
+        // shows the latest snapshot, the value only tells the host that it changed
+        const auto valToStrStats = [&registry = statistics, i](float, int)
+        {
+            const auto snapshot = registry.snapshot();
+            if (i == QualityTierParameter)
+                return juce::String(quality::getName(snapshot.qualityTier));
+            return juce::String(getStatsValue(snapshot, i));
+        };
+        statsGroup->addChild(std::make_unique<juce::AudioParameterFloat>
+        (
+            "stats" + name.removeCharacters(" "), "Stats " + name, makeRange::lin(0.f, 1.f), 0.f,
+            atrStats.withStringFromValueFunction(valToStrStats)
+        ));
+    }
+    layout.add(std::move(statsGroup));
+    return layout;
 }
 
 XenAudioProcessor::XenAudioProcessor()
@@ -120,25 +214,64 @@ XenAudioProcessor::XenAudioProcessor()
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
                        ),
+    scaleLibrary(),
+    statistics(),
     apvts(*this, nullptr, JucePlugin_Name, createParameters()),
-	xenSnap(*apvts.getParameter("xensnap")),
-    xen(*apvts.getParameter("xen")),
-    anchorFreq(*apvts.getParameter("anchorfreq")),
-    stepsIn12(*apvts.getParameter("stepsIn12")),
-    mode(*apvts.getParameter("mode")),
-    pbRange(*apvts.getParameter("pbrange")),
+	xenSnap(*apvts.getRawParameterValue("xensnap")),
+    xen(*apvts.getRawParameterValue("xen")),
+    anchorFreq(*apvts.getRawParameterValue("anchorfreq")),
+    stepsIn12(*apvts.getRawParameterValue("stepsIn12")),
+    mode(*apvts.getRawParameterValue("mode")),
+    pbRange(*apvts.getRawParameterValue("pbrange")),
+    multiChannel(*apvts.getRawParameterValue("multichannel")),
+    scale(*apvts.getRawParameterValue("scale")),
+    modType(*apvts.getRawParameterValue("modtype")),
+    modRate(*apvts.getRawParameterValue("modrate")),
+    modXen(*apvts.getRawParameterValue("modxen")),
+    modAnchor(*apvts.getRawParameterValue("modanchor")),
+    modCC(*apvts.getRawParameterValue("modcc")),
+    modSteps(),
+    scaleParameter(*apvts.getParameter("scale")),
+    statsParameters(),
+    timerTicks(0),
     autoMPEProcessor(),
     mpeSplit(),
-    xenProcessor(mpeSplit),
-    xenSnapped(true)
+    xenProcessor(mpeSplit, statistics),
+    xenSnapped(true),
+    parameterGeneration(1),
+    processedGeneration(0),
+    changePoints(),
+    numChangePoints(0),
+    qualityScheduler(),
+    qualityTier(quality::Tier::Full)
+   #if XEN_TRACE
+    , traceRing()
+   #endif
 #endif
 {
-    
+    for (auto i = 0; i < mod::Modulator::NumSteps; ++i)
+        modSteps[i] = apvts.getRawParameterValue("modstep" + juce::String(i + 1));
+    auto statsIdx = 0;
+    for (auto parameter : getParameters())
+    {
+        // through the value tree state, which calls listeners after its raw value is stored,
+        // so the audio thread never sees the new generation with the old value
+        if (isStatsParameter(parameter))
+            statsParameters[statsIdx++] = parameter;
+        else if (auto ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter))
+            apvts.addParameterListener(ranged->getParameterID(), this);
+    }
+    scaleLibrary->addChangeListener(this);
 }
 
 XenAudioProcessor::~XenAudioProcessor()
 {
-    
+    stopTimer();
+    scaleLibrary->removeChangeListener(this);
+    for (auto parameter : getParameters())
+        if (auto ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter))
+            if (!isStatsParameter(ranged))
+                apvts.removeParameterListener(ranged->getParameterID(), this);
 }
 
 const juce::String XenAudioProcessor::getName() const
@@ -168,21 +301,24 @@ double XenAudioProcessor::getTailLengthSeconds() const
 
 int XenAudioProcessor::getNumPrograms()
 {
-    return 1;
+    return 1 + juce::jmin(scaleLibrary->getNumScales(), axiom::MaxScales);
 }
 
 int XenAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return static_cast<int>(scale.load());
 }
 
-void XenAudioProcessor::setCurrentProgram(int)
+void XenAudioProcessor::setCurrentProgram(int idx)
 {
+    scaleParameter.setValueNotifyingHost(scaleParameter.convertTo0to1(static_cast<float>(idx)));
 }
 
-const juce::String XenAudioProcessor::getProgramName(int)
+const juce::String XenAudioProcessor::getProgramName(int idx)
 {
-    return {};
+    if (idx == 0)
+        return "Equal Temperament";
+    return scaleLibrary->getName(idx - 1);
 }
 
 void XenAudioProcessor::changeProgramName(int, const juce::String&)
@@ -191,11 +327,94 @@ void XenAudioProcessor::changeProgramName(int, const juce::String&)
 
 void XenAudioProcessor::prepareToPlay(double sampleRate, int)
 {
+    scaleLibrary->load();
+    autoMPEProcessor.prepare(xen::Xen::MidiBufferBytes);
+    mpeSplit.prepare(xen::Xen::MidiBufferBytes);
     xenProcessor.prepare(sampleRate);
+    qualityScheduler.prepare(sampleRate);
+    setQualityTier(quality::Tier::Full);
+    // prepare resets the tables, so they get rebuilt from the parameters
+    parameterGeneration.fetch_add(1);
+    startTimerHz(TimerHz);
 }
 
 void XenAudioProcessor::releaseResources()
 {
+    xenProcessor.release();
+    stopTimer();
+    timerCallback();
+    // the meters show the end of the render
+    updateStatsParameters();
+    // opt in at runtime, e.g. XEN_STATS_DUMP=1 in the host's environment, so released builds can dump too
+    if (juce::SystemStats::getEnvironmentVariable("XEN_STATS_DUMP", {}) == "1")
+        dumpStatistics();
+}
+
+void XenAudioProcessor::timerCallback()
+{
+    xenProcessor.updateMaster();
+    xenProcessor.checkTuningBus();
+    xenProcessor.releasePreloadedTable();
+    timerTicks = (timerTicks + 1) % (TimerHz / StatsUpdateHz);
+    if (timerTicks == 0)
+        updateStatsParameters();
+}
+
+void XenAudioProcessor::updateStatsParameters()
+{
+    // value changes of non-automatable meters, a changed parameter info would make hosts rescan all parameters
+    const auto snapshot = statistics.snapshot();
+    for (auto i = 0; i < NumStatsParameters; ++i)
+    {
+        const auto value = static_cast<double>(getStatsValue(snapshot, i));
+        const auto norm = static_cast<float>(std::log2(1. + value) / 64.);
+        if (statsParameters[i]->getValue() != norm)
+            statsParameters[i]->setValueNotifyingHost(norm);
+    }
+}
+
+juce::uint64 XenAudioProcessor::getStatsValue(const stats::Snapshot& snapshot, int i) noexcept
+{
+    if (i < stats::NumCounters)
+        return snapshot.counters[i];
+    if (i == QualityTierParameter)
+        return static_cast<juce::uint64>(snapshot.qualityTier);
+    return snapshot.getBlockTimeUs(i == stats::NumCounters ? .5 : .99);
+}
+
+bool XenAudioProcessor::isStatsParameter(const juce::AudioProcessorParameter* parameter) noexcept
+{
+    return parameter->getCategory() == juce::AudioProcessorParameter::otherMeter;
+}
+
+void XenAudioProcessor::dumpStatistics() const
+{
+    auto dump = statistics.snapshot().toVar();
+    auto obj = dump.getDynamicObject();
+    obj->setProperty("instance", statistics.getId());
+    const auto masterState = xenProcessor.getMasterState();
+    obj->setProperty("mtsMaster", masterState == xen::MTSMaster::State::Registered ? "registered" :
+        masterState == xen::MTSMaster::State::Idle ? "idle" : "blocked");
+    obj->setProperty("kernels", simd::getName(xenProcessor.getKernelPath()));
+    const auto toVar = [](const auto& cacheStats)
+    {
+        auto cache = new juce::DynamicObject();
+        cache->setProperty("hits", cacheStats.hits);
+        cache->setProperty("misses", cacheStats.misses);
+        cache->setProperty("entriesInUse", cacheStats.entriesInUse);
+        cache->setProperty("entriesCached", cacheStats.entriesCached);
+        cache->setProperty("bytes", static_cast<juce::int64>(cacheStats.bytes));
+        return juce::var(cache);
+    };
+    obj->setProperty("tuningCache", toVar(xenProcessor.getTuningCacheStats()));
+    obj->setProperty("channelTableCache", toVar(xenProcessor.getChannelTableCacheStats()));
+
+    const auto name = "xen-stats-" + juce::String(juce::Process::getCurrentProcessId()) +
+        "-" + juce::String(statistics.getId()) + ".json";
+    const auto file = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("Mrugalla").getChildFile("Xen").getChildFile("Stats").getChildFile(name);
+    if (file.getParentDirectory().createDirectory().wasOk())
+        file.replaceWithText(juce::JSON::toString(dump));
 }
 
 bool XenAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
@@ -209,29 +428,154 @@ bool XenAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
 
 void XenAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midi)
 {
+    XEN_TRACE_BLOCK(traceRing);
+    XEN_TRACE_SCOPE("processBlock");
+    XEN_RT_SCOPE();
     const juce::ScopedNoDenormals noDenormals;
     const auto numSamples = buffer.getNumSamples();
     if (numSamples == 0)
         return;
+    const auto startTime = std::chrono::steady_clock::now();
+    // offline renders may take as long as they need, so they always get full quality
+    if (isNonRealtime())
+    {
+        qualityScheduler.reset();
+        setQualityTier(quality::Tier::Full);
+    }
+    statistics.add(stats::Counter::Blocks);
+    statistics.add(stats::Counter::EventsIn, static_cast<juce::uint64>(midi.getNumEvents()));
     {
 		const auto totalNumOutputChannels = getTotalNumOutputChannels();
 		const auto totalNumInputChannels = getTotalNumInputChannels();
 		for (auto i = totalNumOutputChannels; i < totalNumInputChannels; ++i)
 			buffer.clear(i, 0, numSamples);
     }
-    autoMPEProcessor(midi);
-    mpeSplit(midi);
+    {
+        XEN_TRACE_SCOPE("modulation midi");
+        xenProcessor.processModulationMidi(midi);
+        xenProcessor.processThru(midi);
+    }
+    {
+        XEN_TRACE_SCOPE("auto mpe");
+        autoMPEProcessor(midi);
+        statistics.add(stats::Counter::VoicesStolen, static_cast<juce::uint64>(autoMPEProcessor.getNumStolen()));
+    }
+    {
+        XEN_TRACE_SCOPE("mpe split");
+        mpeSplit(midi);
+    }
+    {
+        XEN_TRACE_SCOPE("sysex in");
+        xenProcessor.processSysex(midi);
+    }
 
-    xenSnapped = xenSnap.getValue() > .5f;
-	const auto xenV = xen.convertFrom0to1(xen.getValue());
-	const auto anchorFreqV = math::noteToFreq(anchorFreq.convertFrom0to1(anchorFreq.getValue()));
-	const auto pbRangeV = pbRange.convertFrom0to1(pbRange.getValue());
-	const auto mtsEnabledV = mode.getValue() > .5f;
-	const auto stepsIn12V = stepsIn12.getValue() > .5f;
-    xenProcessor.updateParameters(xenV, anchorFreqV, pbRangeV, mtsEnabledV, stepsIn12V);
+    // loaded before reading the values, so a change during the update is picked up next block
+    const auto generation = parameterGeneration.load();
+    const auto parametersChanged = processedGeneration != generation;
+    processedGeneration = generation;
+    if (parametersChanged)
+        updateModulation();
 
 	auto samples = buffer.getArrayOfWritePointers();
-    xenProcessor(samples, midi, numSamples);
+    if (numChangePoints != 0)
+        processSubBlocks(samples, midi, numSamples);
+    else
+    {
+        if (parametersChanged)
+            updateParameters();
+        xenProcessor(samples, midi, numSamples);
+    }
+
+    statistics.add(stats::Counter::EventsOut, static_cast<juce::uint64>(midi.getNumEvents()));
+    const auto elapsed = std::chrono::steady_clock::now() - startTime;
+    const auto elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    statistics.addBlockTime(elapsedNs);
+    // sustained overruns of the block's budget degrade the synth from the next block on
+    if (!isNonRealtime())
+        setQualityTier(qualityScheduler(elapsedNs, numSamples));
+}
+
+void XenAudioProcessor::setQualityTier(quality::Tier tier) noexcept
+{
+    if (tier == qualityTier)
+        return;
+    if (tier > qualityTier)
+        statistics.add(stats::Counter::QualityStepDowns);
+    qualityTier = tier;
+    xenProcessor.setQuality(tier);
+    statistics.setQualityTier(tier);
+}
+
+void XenAudioProcessor::updateModulation()
+{
+    XEN_TRACE_SCOPE("update modulation");
+    double modStepsV[mod::Modulator::NumSteps];
+    for (auto i = 0; i < mod::Modulator::NumSteps; ++i)
+        modStepsV[i] = static_cast<double>(modSteps[i]->load());
+    const auto modTypeV = static_cast<mod::Type>(static_cast<int>(modType.load()));
+    const auto modRateV = static_cast<double>(modRate.load());
+    const auto modXenV = static_cast<double>(modXen.load());
+    const auto modAnchorV = static_cast<double>(modAnchor.load());
+    const auto modCCV = static_cast<int>(modCC.load());
+    xenProcessor.updateModulation(modTypeV, modRateV, modXenV, modAnchorV, modCCV, modStepsV);
+}
+
+xen::Xen::Parameters XenAudioProcessor::getXenParameters() const
+{
+    const auto xenV = static_cast<double>(xen.load());
+    const auto anchorFreqV = math::noteToFreq(static_cast<double>(anchorFreq.load()));
+    const auto pbRangeV = static_cast<double>(pbRange.load());
+    const auto modeV = static_cast<xen::Mode>(static_cast<int>(mode.load()));
+    const auto stepsIn12V = stepsIn12.load() > .5f;
+    const auto multiChannelV = multiChannel.load() > .5f;
+    const auto scaleIdx = static_cast<int>(scale.load());
+    const auto scaleV = scaleLibrary->getScale(scaleIdx - 1);
+    return { xenV, anchorFreqV, pbRangeV, modeV, stepsIn12V, multiChannelV, scaleV };
+}
+
+void XenAudioProcessor::updateParameters()
+{
+    XEN_TRACE_SCOPE("update parameters");
+    xenSnapped = xenSnap.load() > .5f;
+    xenProcessor.updateParameters(getXenParameters());
+}
+
+bool XenAudioProcessor::addChangePoint(int offset, const xen::Xen::Parameters& parameters) noexcept
+{
+    if (numChangePoints == MaxChangePoints)
+        return false;
+    auto i = numChangePoints;
+    while (i > 0 && changePoints[i - 1].offset > offset)
+    {
+        changePoints[i] = changePoints[i - 1];
+        --i;
+    }
+    changePoints[i] = { offset, parameters };
+    ++numChangePoints;
+    return true;
+}
+
+void XenAudioProcessor::processSubBlocks(float* const* samples, juce::MidiBuffer& midi, int numSamples)
+{
+    XEN_TRACE_SCOPE("sub blocks");
+    // the block continues with the previous values until the first change point
+    xenProcessor.beginBlock();
+    auto s = 0;
+    for (auto i = 0; i < numChangePoints; ++i)
+    {
+        const auto& point = changePoints[i];
+        const auto offset = juce::jlimit(s, numSamples, point.offset);
+        if (offset > s)
+            xenProcessor.process(samples, s, offset);
+        xenProcessor.updateParameters(point.parameters);
+        s = offset;
+    }
+    if (s < numSamples)
+        xenProcessor.process(samples, s, numSamples);
+    xenProcessor.endBlock(midi, numSamples);
+    numChangePoints = 0;
+    // the change points moved the processor away from the parameters' current values
+    parameterGeneration.fetch_add(1);
 }
 
 bool XenAudioProcessor::hasEditor() const
@@ -245,16 +589,99 @@ juce::AudioProcessorEditor* XenAudioProcessor::createEditor()
 
 void XenAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    auto state = apvts.copyState();
-    std::unique_ptr<juce::XmlElement> xml(state.createXml());
-    copyXmlToBinary(*xml, destData);
+    state::Data data;
+    for (auto parameter : getParameters())
+        if (auto ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter); ranged != nullptr && !isStatsParameter(ranged))
+            data.parameters.push_back({ ranged->getParameterID(), ranged->convertFrom0to1(ranged->getValue()) });
+    const auto parameters = getXenParameters();
+    if (parameters.scale != nullptr)
+    {
+        data.scale = *parameters.scale;
+        data.hasScale = true;
+    }
+    data.hasTable = xenProcessor.copyTable(parameters, data.table);
+    state::write(data, destData);
 }
 void XenAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
+    state::Data binaryState;
+    if (state::read(binaryState, data, sizeInBytes))
+        return restoreState(binaryState);
+    // sessions from before the binary state
     std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
-    if (xmlState.get() != nullptr)
-        if (xmlState->hasTagName(apvts.state.getType()))
-            apvts.replaceState(juce::ValueTree::fromXml(*xmlState));
+    if (xmlState.get() == nullptr || !xmlState->hasTagName(apvts.state.getType()))
+        return;
+    if (auto modeState = xmlState->getChildByAttribute("id", "mode"); modeState != nullptr)
+        modeState->setAttribute("value", migrateMode(static_cast<float>(modeState->getDoubleAttribute("value"))));
+    apvts.replaceState(juce::ValueTree::fromXml(*xmlState));
+}
+
+float XenAudioProcessor::migrateMode(float idx) noexcept
+{
+    return idx == 1.f ? 2.f : idx == 2.f ? 1.f : idx;
+}
+
+void XenAudioProcessor::restoreState(const state::Data& data)
+{
+    // the saved scale is looked up in the library below
+    scaleLibrary->load();
+    // without notifying the host for each parameter, it is told once at the end.
+    // the value tree state's raw value, which the audio thread reads, is stored directly
+    const auto restore = [this](juce::RangedAudioParameter& parameter, float value)
+    {
+        parameter.setValue(value);
+        if (auto raw = apvts.getRawParameterValue(parameter.getParameterID()))
+            raw->store(parameter.convertFrom0to1(parameter.getValue()));
+    };
+
+    // parameters missing from the state go back to their defaults, like with replaceState
+    for (auto parameter : getParameters())
+    {
+        auto ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter);
+        if (ranged == nullptr || isStatsParameter(ranged))
+            continue;
+        const auto id = ranged->getParameterID();
+        const auto it = std::find_if(data.parameters.begin(), data.parameters.end(), [&id](const state::Parameter& p)
+        {
+            return p.id == id;
+        });
+        const auto value = it != data.parameters.end() ?
+            ranged->convertTo0to1(it->value) : ranged->getDefaultValue();
+        restore(*ranged, value);
+    }
+
+    // the library might have changed since saving, so the scale is looked up by its content
+    const auto isSavedScale = [&data](const scala::Scale* s)
+    {
+        return s != nullptr && s->name == data.scale.name &&
+            s->absolute == data.scale.absolute && s->cents == data.scale.cents;
+    };
+    if (data.hasScale && !isSavedScale(scaleLibrary->getScale(static_cast<int>(scale.load()) - 1)))
+        for (auto i = 0; i < juce::jmin(scaleLibrary->getNumScales(), axiom::MaxScales); ++i)
+            if (isSavedScale(scaleLibrary->getScale(i)))
+            {
+                restore(scaleParameter, scaleParameter.convertTo0to1(static_cast<float>(i + 1)));
+                break;
+            }
+
+    const auto parameters = getXenParameters();
+    const auto tableMatches = data.hasScale ? isSavedScale(parameters.scale) : parameters.scale == nullptr;
+    if (data.hasTable && tableMatches)
+        xenProcessor.preloadTable(parameters, data.table);
+    parameterGeneration.fetch_add(1);
+    updateHostDisplay(ChangeDetails().withParameterInfoChanged(true));
+}
+
+void XenAudioProcessor::changeListenerCallback(juce::ChangeBroadcaster*)
+{
+    // the scale index may point to a different scale now
+    parameterGeneration.fetch_add(1);
+    updateHostDisplay(ChangeDetails().withProgramChanged(true).withParameterInfoChanged(true));
+}
+
+void XenAudioProcessor::parameterChanged(const juce::String&, float)
+{
+    parameterGeneration.fetch_add(1);
 }
 
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
@@ -3,9 +3,18 @@
 
 #include <JuceHeader.h>
 #include "AutoMPE.h"
+#include "Quality.h"
+#include "Realtime.h"
+#include "ScaleLibrary.h"
+#include "State.h"
+#include "Stats.h"
+#include "Trace.h"
 #include "Xen.h"
 
-struct XenAudioProcessor : public juce::AudioProcessor
+struct XenAudioProcessor : public juce::AudioProcessor,
+                           public juce::ChangeListener,
+                           public juce::AudioProcessorValueTreeState::Listener,
+                           public juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -32,14 +41,73 @@ struct XenAudioProcessor : public juce::AudioProcessor
     void changeProgramName (int, const juce::String&) override;
     void getStateInformation (juce::MemoryBlock&) override;
     void setStateInformation (const void*, int) override;
+    void changeListenerCallback(juce::ChangeBroadcaster*) override;
+    void parameterChanged(const juce::String&, float) override;
+    void timerCallback() override;
+    // offset, parameters
+    // lets a format wrapper that knows the sample offsets of automation points
+    // (vst3 parameter queues, clap events) hand them in before processBlock.
+    // audio thread only: not synchronised, so it has to be called on the thread that runs
+    // processBlock, right before the block that uses up the points. false if they're full.
+    // juce's wrappers don't pass the offsets on, so only XenTools render calls it so far
+    bool addChangePoint(int, const xen::Xen::Parameters&) noexcept;
     juce::AudioProcessorValueTreeState::ParameterLayout createParameters();
 
+    juce::SharedResourcePointer<scala::Library> scaleLibrary;
+    // before apvts, the stats parameters display it
+    stats::Registry statistics;
     juce::AudioProcessorValueTreeState apvts;
-    juce::RangedAudioParameter &xenSnap, &xen, &anchorFreq, &stepsIn12, &mode, &pbRange;
+    // denormalised values, read lock-free on the audio thread
+    std::atomic<float> &xenSnap, &xen, &anchorFreq, &stepsIn12, &mode, &pbRange, &multiChannel, &scale,
+        &modType, &modRate, &modXen, &modAnchor, &modCC;
+    std::array<std::atomic<float>*, mod::Modulator::NumSteps> modSteps;
+    juce::RangedAudioParameter& scaleParameter;
+    // read-only page of the statistics in the host: the counters, then block time p50 and p99
+    // and the synth's quality tier
+    static constexpr int NumStatsParameters = stats::NumCounters + 3;
+    static constexpr int QualityTierParameter = stats::NumCounters + 2;
+    // the timer beats for the tuning bus and releases tables, the meters only change every few ticks
+    static constexpr int TimerHz = 4;
+    static constexpr int StatsUpdateHz = 1;
+    std::array<juce::AudioProcessorParameter*, NumStatsParameters> statsParameters;
+    int timerTicks;
     mpe::AutoMPE autoMPEProcessor;
     mpe::Split mpeSplit;
     xen::Xen xenProcessor;
     bool xenSnapped;
+    // bumped by every parameter change, so blocks without changes skip the parameter update
+    std::atomic<juce::uint32> parameterGeneration;
+    juce::uint32 processedGeneration;
+
+    struct ChangePoint
+    {
+        int offset;
+        xen::Xen::Parameters parameters;
+    };
+    static constexpr int MaxChangePoints = 64;
+    std::array<ChangePoint, MaxChangePoints> changePoints;
+    int numChangePoints;
+    quality::Scheduler qualityScheduler;
+    quality::Tier qualityTier;
+   #if XEN_TRACE
+    trace::Ring traceRing;
+   #endif
+
+    xen::Xen::Parameters getXenParameters() const;
+    void updateModulation();
+    void updateParameters();
+    void restoreState(const state::Data&);
+    // mode index of a session from before sysex moved in front of mts-esp
+    static float migrateMode(float) noexcept;
+    void processSubBlocks(float* const*, juce::MidiBuffer&, int);
+    void setQualityTier(quality::Tier) noexcept;
+    // writes the statistics of this instance next to the other instances'
+    void dumpStatistics() const;
+    // message thread. tells the host about the meters that changed
+    void updateStatsParameters();
+    static bool isStatsParameter(const juce::AudioProcessorParameter*) noexcept;
+    // snapshot, stats parameter index
+    static juce::uint64 getStatsValue(const stats::Snapshot&, int) noexcept;
 };
 
 /*
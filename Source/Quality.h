@@ -0,0 +1,136 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+// xen's synth is only there to check the tuning, so under load it gives up sound quality
+// rather than risk a dropout. the tiers add up: each one keeps the savings of the ones before.
+// the midi output is never degraded
+namespace quality
+{
+	enum class Tier
+	{
+		Full,
+		// sine without the tanh saturation
+		CheapOsc,
+		// envelopes step at a control rate instead of every sample
+		ControlRateEnv,
+		// only the first few sounding voices are rendered
+		FewerVoices,
+		// notes are still tracked, so none hang when it comes back
+		SynthOff,
+		NumTiers
+	};
+
+	static constexpr int NumTiers = static_cast<int>(Tier::NumTiers);
+
+	inline const char* getName(Tier tier) noexcept
+	{
+		static constexpr const char* Names[NumTiers] =
+		{
+			"full", "cheap osc", "control rate env", "fewer voices", "synth off"
+		};
+		return Names[static_cast<int>(tier)];
+	}
+
+	// compares each block's time with its real-time budget. sustained overruns step down
+	// a tier, a long calm steps back up. if a step up relapses before it held for the calm time,
+	// the next step up waits twice as long
+	class Scheduler
+	{
+	public:
+		// share of the block's budget above which a block overruns
+		static constexpr double OverrunLoad = .7;
+		// share of the block's budget below which a block is calm
+		static constexpr double CalmLoad = .35;
+		// overrun time that steps down, calm blocks wear it off again
+		static constexpr double StepDownSeconds = .05;
+		// calm time that steps up
+		static constexpr double StepUpSeconds = 2.;
+		static constexpr double MaxStepUpSeconds = 32.;
+
+		Scheduler() :
+			nsPerSample(0.),
+			stepDownSamples(0),
+			minStepUpSamples(0),
+			maxStepUpSamples(0),
+			stepUpSamples(0),
+			overrunSamples(0),
+			calmSamples(0),
+			heldSamples(0),
+			tier(Tier::Full)
+		{}
+
+		void prepare(double sampleRate) noexcept
+		{
+			nsPerSample = 1e9 / sampleRate;
+			stepDownSamples = static_cast<int64_t>(StepDownSeconds * sampleRate);
+			minStepUpSamples = static_cast<int64_t>(StepUpSeconds * sampleRate);
+			maxStepUpSamples = static_cast<int64_t>(MaxStepUpSeconds * sampleRate);
+			reset();
+		}
+
+		// full quality and no history, e.g. while rendering offline
+		void reset() noexcept
+		{
+			stepUpSamples = minStepUpSamples;
+			overrunSamples = 0;
+			calmSamples = 0;
+			heldSamples = maxStepUpSamples;
+			tier = Tier::Full;
+		}
+
+		// elapsedNs, numSamples
+		// the tier of the next block
+		Tier operator()(int64_t elapsedNs, int numSamples) noexcept
+		{
+			const auto budgetNs = static_cast<double>(numSamples) * nsPerSample;
+			const auto load = static_cast<double>(elapsedNs) / budgetNs;
+			heldSamples = std::min(heldSamples + numSamples, maxStepUpSamples);
+			// held at full quality for long enough, relapses are forgotten
+			if (tier == Tier::Full && heldSamples == maxStepUpSamples)
+				stepUpSamples = minStepUpSamples;
+
+			if (load > OverrunLoad)
+			{
+				calmSamples = 0;
+				overrunSamples += numSamples;
+				if (overrunSamples >= stepDownSamples && tier != Tier::SynthOff)
+					stepDown();
+				return tier;
+			}
+			overrunSamples = std::max(static_cast<int64_t>(0), overrunSamples - numSamples);
+			calmSamples = load < CalmLoad ? calmSamples + numSamples : 0;
+			if (calmSamples >= stepUpSamples && tier != Tier::Full)
+				stepUp();
+			return tier;
+		}
+
+		Tier getTier() const noexcept
+		{
+			return tier;
+		}
+
+	private:
+		double nsPerSample;
+		int64_t stepDownSamples, minStepUpSamples, maxStepUpSamples, stepUpSamples;
+		// overrunSamples is leaky, heldSamples counts since the last step up
+		int64_t overrunSamples, calmSamples, heldSamples;
+		Tier tier;
+
+		void stepDown() noexcept
+		{
+			if (heldSamples < stepUpSamples)
+				stepUpSamples = std::min(stepUpSamples * 2, maxStepUpSamples);
+			tier = static_cast<Tier>(static_cast<int>(tier) + 1);
+			overrunSamples = 0;
+			calmSamples = 0;
+		}
+
+		void stepUp() noexcept
+		{
+			tier = static_cast<Tier>(static_cast<int>(tier) - 1);
+			calmSamples = 0;
+			heldSamples = 0;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#include "Realtime.h"
+
+#if XEN_RT_CHECK
+namespace rt
+{
+	// zero-initialised tls, so reading it from inside malloc doesn't allocate
+	static thread_local bool realtime = false;
+
+	bool isRealtime() noexcept
+	{
+		return realtime;
+	}
+
+	Scope::Scope() noexcept :
+		previous(realtime)
+	{
+		realtime = true;
+	}
+
+	Scope::~Scope()
+	{
+		realtime = previous;
+	}
+}
+#endif
\ No newline at end of file
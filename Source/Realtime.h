@@ -0,0 +1,30 @@
+#pragma once
+
+// marks the code that runs on the audio thread, so that a test build can catch allocations
+// and locks in there. compiled out unless XEN_RT_CHECK is 1, the macros expand to nothing then
+#ifndef XEN_RT_CHECK
+	#define XEN_RT_CHECK 0
+#endif
+
+#if XEN_RT_CHECK
+namespace rt
+{
+	// true while the calling thread is inside a realtime scope
+	bool isRealtime() noexcept;
+
+	class Scope
+	{
+	public:
+		Scope() noexcept;
+
+		~Scope();
+
+	private:
+		bool previous;
+	};
+}
+
+#define XEN_RT_SCOPE() const rt::Scope xenRealtimeScope
+#else
+#define XEN_RT_SCOPE()
+#endif
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "Scala.h"
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+namespace scala
+{
+	static constexpr int NumNotes = 128;
+
+	int Scale::size() const noexcept
+	{
+		return static_cast<int>(cents.size());
+	}
+
+	double Scale::period() const noexcept
+	{
+		if (absolute || cents.empty())
+			return 1200.;
+		return cents.back();
+	}
+
+	double Scale::noteToCents(int note, int anchorNote) const noexcept
+	{
+		if (absolute)
+			return cents[note] - cents[anchorNote];
+
+		const auto numSteps = size();
+		const auto steps = note - anchorNote;
+		auto octave = steps / numSteps;
+		auto degree = steps - octave * numSteps;
+		if (degree < 0)
+		{
+			degree += numSteps;
+			--octave;
+		}
+		const auto degreeCents = degree == 0 ? 0. : cents[degree - 1];
+		return degreeCents + static_cast<double>(octave) * period();
+	}
+
+	bool Scale::isValid() const noexcept
+	{
+		if (absolute)
+			return cents.size() == NumNotes;
+		return !cents.empty() && period() > 0.;
+	}
+
+	// iterates the lines of a non-null-terminated buffer
+	struct LineReader
+	{
+		LineReader(const char* _data, size_t _size) :
+			data(_data),
+			end(_data + _size)
+		{}
+
+		bool next(std::string& line)
+		{
+			if (data >= end)
+				return false;
+			const auto start = data;
+			while (data < end && *data != '\n' && *data != '\r')
+				++data;
+			line.assign(start, data);
+			if (data < end && *data == '\r')
+				++data;
+			if (data < end && *data == '\n')
+				++data;
+			return true;
+		}
+
+	private:
+		const char* data;
+		const char* end;
+	};
+
+	static std::string trim(const std::string& s)
+	{
+		const auto first = s.find_first_not_of(" \t");
+		if (first == std::string::npos)
+			return {};
+		const auto last = s.find_last_not_of(" \t");
+		return s.substr(first, last - first + 1);
+	}
+
+	static String toString(const std::string& s)
+	{
+		return String::createStringFromData(s.data(), static_cast<int>(s.size())).trim();
+	}
+
+	static bool parsePitch(const std::string& line, double& cents)
+	{
+		const auto text = trim(line);
+		if (text.empty())
+			return false;
+		const auto begin = text.c_str();
+		char* end = nullptr;
+		if (text.find('.') != std::string::npos)
+		{
+			cents = std::strtod(begin, &end);
+			return end != begin;
+		}
+		const auto num = std::strtod(begin, &end);
+		if (end == begin || num <= 0.)
+			return false;
+		auto den = 1.;
+		if (*end == '/')
+		{
+			const auto denBegin = end + 1;
+			den = std::strtod(denBegin, &end);
+			if (end == denBegin || den <= 0.)
+				return false;
+		}
+		cents = 1200. * std::log2(num / den);
+		return true;
+	}
+
+	bool parseScl(Scale& scale, const char* data, size_t size)
+	{
+		LineReader reader(data, size);
+		std::string line;
+		auto numNotes = -1;
+		auto hasName = false;
+		scale.cents.clear();
+		scale.absolute = false;
+
+		while (reader.next(line))
+		{
+			if (!line.empty() && line[0] == '!')
+				continue;
+			if (!hasName)
+			{
+				scale.name = toString(line);
+				hasName = true;
+			}
+			else if (numNotes < 0)
+			{
+				numNotes = std::atoi(trim(line).c_str());
+				if (numNotes <= 0)
+					return false;
+				scale.cents.reserve(numNotes);
+			}
+			else
+			{
+				auto cents = 0.;
+				if (!parsePitch(line, cents))
+					return false;
+				scale.cents.push_back(cents);
+				if (scale.size() == numNotes)
+					return scale.isValid();
+			}
+		}
+		return false;
+	}
+
+	bool parseTun(Scale& scale, const char* data, size_t size)
+	{
+		LineReader reader(data, size);
+		std::string line;
+		std::string section;
+		std::vector<bool> exact(NumNotes, false);
+		auto numNotes = 0;
+		scale.cents.assign(NumNotes, 0.);
+		scale.absolute = true;
+		for (auto i = 0; i < NumNotes; ++i)
+			scale.cents[i] = static_cast<double>(i) * 100.;
+
+		while (reader.next(line))
+		{
+			const auto text = trim(line);
+			if (text.empty() || text[0] == ';')
+				continue;
+			if (text[0] == '[')
+			{
+				section = juce::String(text).toLowerCase().toStdString();
+				continue;
+			}
+			const auto eq = text.find('=');
+			if (eq == std::string::npos)
+				continue;
+			const auto key = juce::String(trim(text.substr(0, eq))).toLowerCase();
+			const auto value = trim(text.substr(eq + 1));
+
+			if (key == "name" && (section == "[info]" || section == "[scale begin]"))
+			{
+				scale.name = toString(value).unquoted();
+				continue;
+			}
+			const auto isExact = section == "[exact tuning]";
+			if (!isExact && section != "[tuning]")
+				continue;
+			if (!key.startsWith("note"))
+				continue;
+			const auto note = key.substring(4).trim().getIntValue();
+			if (note < 0 || note >= NumNotes)
+				continue;
+			if (!isExact && exact[note])
+				continue;
+			scale.cents[note] = std::strtod(value.c_str(), nullptr);
+			exact[note] = isExact;
+			++numNotes;
+		}
+		return numNotes > 0;
+	}
+
+	bool parse(Scale& scale, const File& file, const char* data, size_t size)
+	{
+		const auto ok = file.hasFileExtension("tun") ?
+			parseTun(scale, data, size) :
+			parseScl(scale, data, size);
+		if (ok && scale.name.isEmpty())
+			scale.name = file.getFileNameWithoutExtension();
+		return ok;
+	}
+
+	bool parse(Scale& scale, const File& file)
+	{
+		const juce::MemoryMappedFile mapped(file, juce::MemoryMappedFile::readOnly);
+		const auto data = static_cast<const char*>(mapped.getData());
+		if (data == nullptr)
+			return false;
+		return parse(scale, file, data, mapped.getSize());
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <vector>
+
+namespace scala
+{
+	using String = juce::String;
+	using File = juce::File;
+
+	struct Scale
+	{
+		Scale() :
+			name(""),
+			cents(),
+			absolute(false)
+		{}
+
+		// steps per period (128 for absolute tables)
+		int size() const noexcept;
+
+		// period in cents
+		double period() const noexcept;
+
+		// note, anchorNote
+		double noteToCents(int, int) const noexcept;
+
+		bool isValid() const noexcept;
+
+		String name;
+		// scl: degrees 1 to N in cents, the last one is the period
+		// tun: one absolute cent value per midi note
+		std::vector<double> cents;
+		bool absolute;
+	};
+
+	// scale, data, size
+	bool parseScl(Scale&, const char*, size_t);
+
+	// scale, data, size
+	bool parseTun(Scale&, const char*, size_t);
+
+	// scale, file, data, size (the file extension picks the format)
+	bool parse(Scale&, const File&, const char*, size_t);
+
+	// scale, file (memory-mapped)
+	bool parse(Scale&, const File&);
+}
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "ScaleLibrary.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace scala
+{
+	static constexpr int IndexMagic = 0x58534c49; // XSLI
+	static constexpr int IndexVersion = 1;
+
+	Library::Library() :
+		Thread("Xen Scale Library"),
+		ChangeBroadcaster(),
+		current(nullptr),
+		indexes(),
+		indexesLock(),
+		loaded()
+	{
+	}
+
+	Library::~Library()
+	{
+		stopThread(4000);
+	}
+
+	void Library::load()
+	{
+		std::call_once(loaded, [this]()
+		{
+			auto cached = std::make_unique<Entries>();
+			if (loadIndex(*cached, getIndexFile()))
+				publish(std::move(cached));
+			startThread();
+		});
+	}
+
+	const Scale* Library::getScale(int idx) const noexcept
+	{
+		const auto entries = current.load(std::memory_order_acquire);
+		if (entries == nullptr || idx < 0 || idx >= static_cast<int>(entries->size()))
+			return nullptr;
+		const auto& scale = (*entries)[idx].scale;
+		return scale.isValid() ? &scale : nullptr;
+	}
+
+	int Library::getNumScales() const noexcept
+	{
+		const auto entries = current.load(std::memory_order_acquire);
+		return entries == nullptr ? 0 : static_cast<int>(entries->size());
+	}
+
+	String Library::getName(int idx) const
+	{
+		const auto scale = getScale(idx);
+		return scale == nullptr ? String() : scale->name;
+	}
+
+	void Library::rescan()
+	{
+		load();
+		if (!isThreadRunning())
+			startThread();
+	}
+
+	File Library::getDirectory()
+	{
+		return File::getSpecialLocation(File::userApplicationDataDirectory)
+			.getChildFile("Mrugalla").getChildFile("Xen").getChildFile("Scales");
+	}
+
+	File Library::getIndexFile()
+	{
+		return getDirectory().getSiblingFile("scales.index");
+	}
+
+	void Library::run()
+	{
+		const auto dir = getDirectory();
+		if (dir.createDirectory().failed())
+			return;
+
+		// the published index is the starting point, not the sorted directory, so every
+		// file keeps its slot and the scale parameter, its automation and the program list
+		// still point to the same scales after files are added or removed
+		auto entries = std::make_unique<Entries>();
+		if (const auto published = current.load(std::memory_order_acquire))
+			*entries = *published;
+		std::unordered_map<std::string, int> slots;
+		for (auto i = 0; i < static_cast<int>(entries->size()); ++i)
+			slots[(*entries)[i].path.toStdString()] = i;
+
+		std::vector<bool> found(entries->size(), false);
+		std::vector<int> toParse;
+		Entries added;
+		for (const auto& it : juce::RangedDirectoryIterator(dir, true, "*.scl;*.tun", File::findFiles))
+		{
+			if (threadShouldExit())
+				return;
+			const auto path = it.getFile().getFullPathName();
+			const auto modified = it.getModificationTime().toMilliseconds();
+			const auto slot = slots.find(path.toStdString());
+			if (slot == slots.end())
+			{
+				Entry entry;
+				entry.path = path;
+				entry.modified = modified;
+				added.push_back(std::move(entry));
+				continue;
+			}
+			found[slot->second] = true;
+			auto& entry = (*entries)[slot->second];
+			if (entry.modified != modified)
+			{
+				entry.modified = modified;
+				toParse.push_back(slot->second);
+			}
+		}
+
+		// removed files leave an empty slot behind, modified 0 marks it
+		auto changed = !toParse.empty() || !added.empty();
+		for (auto i = 0; i < static_cast<int>(found.size()); ++i)
+		{
+			auto& entry = (*entries)[i];
+			if (found[i] || entry.modified == 0)
+				continue;
+			entry.modified = 0;
+			entry.scale = Scale();
+			changed = true;
+		}
+
+		// new files go to the end, in path order
+		std::sort(added.begin(), added.end(), [](const Entry& a, const Entry& b)
+		{
+			return a.path < b.path;
+		});
+		for (auto& entry : added)
+		{
+			toParse.push_back(static_cast<int>(entries->size()));
+			entries->push_back(std::move(entry));
+		}
+
+		if (!changed)
+			return;
+		parseParallel(*entries, toParse);
+		if (threadShouldExit())
+			return;
+
+		saveIndex(*entries, getIndexFile());
+		publish(std::move(entries));
+	}
+
+	void Library::publish(std::unique_ptr<Entries> entries)
+	{
+		// old indexes stay alive until destruction, as the audio thread might still read them
+		const juce::ScopedLock lock(indexesLock);
+		current.store(entries.get(), std::memory_order_release);
+		indexes.push_back(std::move(entries));
+		sendChangeMessage();
+	}
+
+	void Library::parseParallel(Entries& entries, const std::vector<int>& toParse)
+	{
+		const auto numJobs = static_cast<int>(toParse.size());
+		const auto numThreads = std::min(numJobs, juce::SystemStats::getNumCpus());
+		std::atomic<int> next(0);
+		const auto job = [&]()
+		{
+			for (auto i = next.fetch_add(1); i < numJobs; i = next.fetch_add(1))
+			{
+				if (threadShouldExit())
+					return;
+				auto& entry = entries[toParse[i]];
+				if (!parse(entry.scale, File(entry.path)))
+					entry.scale.cents.clear();
+			}
+		};
+
+		if (numThreads < 2)
+		{
+			job();
+			return;
+		}
+		juce::ThreadPool pool(numThreads - 1);
+		for (auto t = 1; t < numThreads; ++t)
+			pool.addJob([&job]()
+			{
+				job();
+				return juce::ThreadPoolJob::jobHasFinished;
+			});
+		job();
+		// every file is taken once job returns, so this only waits for the ones still parsing
+		pool.removeAllJobs(false, -1);
+	}
+
+	bool Library::loadIndex(Entries& entries, const File& file)
+	{
+		juce::FileInputStream in(file);
+		if (!in.openedOk())
+			return false;
+		if (in.readInt() != IndexMagic || in.readInt() != IndexVersion)
+			return false;
+		const auto numEntries = in.readInt();
+		if (numEntries < 0)
+			return false;
+		entries.resize(numEntries);
+		for (auto& entry : entries)
+		{
+			entry.path = in.readString();
+			entry.modified = in.readInt64();
+			entry.scale.name = in.readString();
+			entry.scale.absolute = in.readBool();
+			const auto numCents = in.readCompressedInt();
+			if (numCents < 0 || in.isExhausted())
+				return false;
+			entry.scale.cents.resize(numCents);
+			for (auto& cents : entry.scale.cents)
+				cents = in.readDouble();
+		}
+		// empty slots and files that failed to parse have no valid scale
+		return std::all_of(entries.begin(), entries.end(), [](const Entry& e)
+		{
+			return e.path.isNotEmpty();
+		});
+	}
+
+	bool Library::saveIndex(const Entries& entries, const File& file)
+	{
+		const juce::TemporaryFile tmp(file);
+		{
+			juce::FileOutputStream out(tmp.getFile());
+			if (!out.openedOk())
+				return false;
+			out.writeInt(IndexMagic);
+			out.writeInt(IndexVersion);
+			out.writeInt(static_cast<int>(entries.size()));
+			for (const auto& entry : entries)
+			{
+				out.writeString(entry.path);
+				out.writeInt64(entry.modified);
+				out.writeString(entry.scale.name);
+				out.writeBool(entry.scale.absolute);
+				out.writeCompressedInt(entry.scale.size());
+				for (const auto cents : entry.scale.cents)
+					out.writeDouble(cents);
+			}
+			out.flush();
+			if (out.getStatus().failed())
+				return false;
+		}
+		return tmp.overwriteTargetFileWithTemporary();
+	}
+}
\ No newline at end of file
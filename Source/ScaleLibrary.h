@@ -0,0 +1,78 @@
+#pragma once
+#include <juce_events/juce_events.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Scala.h"
+
+namespace scala
+{
+	// process-wide index of the .scl/.tun files in the user's scale folder.
+	// nothing is read before the first load, so plugin scans stay fast.
+	// scanning happens on a background thread, parsing is spread across all cores
+	// and the result is cached on disk, so unchanged files are never opened twice.
+	// getScale is lock-free and O(1), so the audio thread can switch scales directly.
+	// a file keeps its index for as long as the cached index lives: new files are appended
+	// and removed ones leave an empty slot, for which getScale returns nullptr
+	struct Library :
+		public juce::Thread,
+		public juce::ChangeBroadcaster
+	{
+		struct Entry
+		{
+			Entry() :
+				path(""),
+				modified(0),
+				scale()
+			{}
+
+			String path;
+			juce::int64 modified;
+			Scale scale;
+		};
+
+		using Entries = std::vector<Entry>;
+
+		Library();
+
+		~Library() override;
+
+		// not on the audio thread. reads the cached index and starts the first scan,
+		// later calls return right away
+		void load();
+
+		// index
+		const Scale* getScale(int) const noexcept;
+
+		int getNumScales() const noexcept;
+
+		// index
+		String getName(int) const;
+
+		void rescan();
+
+		static File getDirectory();
+
+		static File getIndexFile();
+
+		void run() override;
+
+	private:
+		std::atomic<const Entries*> current;
+		std::vector<std::unique_ptr<Entries>> indexes;
+		juce::CriticalSection indexesLock;
+		std::once_flag loaded;
+
+		void publish(std::unique_ptr<Entries>);
+
+		// entries, file
+		static bool loadIndex(Entries&, const File&);
+
+		// entries, file
+		static bool saveIndex(const Entries&, const File&);
+
+		// entries, indicesToParse
+		void parseParallel(Entries&, const std::vector<int>&);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "Simd.h"
+#include "Math.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// the kernels are plain loops left to the vectorizer, which gcc only runs in full from -O3 on,
+// so the file asks for it whatever the build's optimisation level. clang vectorizes from -O2
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC optimize("tree-vectorize")
+#endif
+
+// the avx paths need target attributes, which msvc doesn't have
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#define XEN_SIMD_MULTIVERSION 1
+#else
+	#define XEN_SIMD_MULTIVERSION 0
+#endif
+
+namespace simd
+{
+	// adding and subtracting 1.5 * 2^52 rounds to the nearest integer,
+	// which then sits in the low bits of the sum
+	static constexpr double RoundMagic = 6755399441055744.;
+	static constexpr std::uint64_t RoundMagicBits = 0x4338000000000000ull;
+	static constexpr double Ln2 = 0.69314718055994530942;
+	static constexpr double TwoLog2e = 2.88539008177792681472;
+
+	namespace scalar
+	{
+		static void osc(float* dest, const double* phase, const double* env,
+			double drive, double gain, int numSamples) noexcept
+		{
+			for (auto i = 0; i < numSamples; ++i)
+				dest[i] += static_cast<float>(std::tanh(drive * std::sin(phase[i])) * gain * env[i]);
+		}
+
+		static void sine(float* dest, const double* phase, const double* env,
+			double gain, int numSamples) noexcept
+		{
+			for (auto i = 0; i < numSamples; ++i)
+				dest[i] += static_cast<float>(std::sin(phase[i]) * gain * env[i]);
+		}
+
+		static void exp2(double* dest, const double* exponents, double scale, int num) noexcept
+		{
+			for (auto i = 0; i < num; ++i)
+				dest[i] = scale * std::exp2(exponents[i]);
+		}
+	}
+
+#define XEN_SIMD_NAMESPACE baseline
+#define XEN_SIMD_TARGET
+#include "SimdKernels.h"
+#undef XEN_SIMD_NAMESPACE
+#undef XEN_SIMD_TARGET
+
+#if XEN_SIMD_MULTIVERSION
+#define XEN_SIMD_NAMESPACE avx2
+#define XEN_SIMD_TARGET __attribute__((target("avx2,fma")))
+#include "SimdKernels.h"
+#undef XEN_SIMD_NAMESPACE
+#undef XEN_SIMD_TARGET
+
+#define XEN_SIMD_NAMESPACE avx512
+// clang doesn't know prefer-vector-width as a target attribute
+#if defined(__clang__)
+	#define XEN_SIMD_TARGET __attribute__((target("avx512f,fma")))
+#else
+	#define XEN_SIMD_TARGET __attribute__((target("avx512f,fma,prefer-vector-width=512")))
+#endif
+#include "SimdKernels.h"
+#undef XEN_SIMD_NAMESPACE
+#undef XEN_SIMD_TARGET
+#endif
+
+	static const Kernels AllKernels[NumPaths] =
+	{
+		{ scalar::osc, scalar::sine, scalar::exp2, Path::Scalar },
+		{ baseline::osc, baseline::sine, baseline::exp2, Path::Baseline },
+	#if XEN_SIMD_MULTIVERSION
+		{ avx2::osc, avx2::sine, avx2::exp2, Path::AVX2 },
+		{ avx512::osc, avx512::sine, avx512::exp2, Path::AVX512 }
+	#else
+		// never picked, isSupported is false
+		{ baseline::osc, baseline::sine, baseline::exp2, Path::AVX2 },
+		{ baseline::osc, baseline::sine, baseline::exp2, Path::AVX512 }
+	#endif
+	};
+
+	const char* getName(Path path) noexcept
+	{
+		switch (path)
+		{
+		case Path::Scalar: return "scalar";
+	#if defined(__x86_64__) || defined(_M_X64)
+		case Path::Baseline: return "sse2";
+	#else
+		case Path::Baseline: return "baseline";
+	#endif
+		case Path::AVX2: return "avx2";
+		case Path::AVX512: return "avx512";
+		default: return "";
+		}
+	}
+
+	bool isSupported(Path path) noexcept
+	{
+		switch (path)
+		{
+		case Path::Scalar:
+		case Path::Baseline:
+			return true;
+	#if XEN_SIMD_MULTIVERSION
+		case Path::AVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		case Path::AVX512:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx512f");
+	#endif
+		default:
+			return false;
+		}
+	}
+
+	static Path selectPath() noexcept
+	{
+		auto p = XEN_SIMD == 0 ? NumPaths - 1 : XEN_SIMD - 1;
+		p = p < 0 ? 0 : p >= NumPaths ? NumPaths - 1 : p;
+		while (!isSupported(static_cast<Path>(p)))
+			--p;
+		return static_cast<Path>(p);
+	}
+
+	const Kernels& getKernels() noexcept
+	{
+		static const auto path = selectPath();
+		return getKernels(path);
+	}
+
+	const Kernels& getKernels(Path path) noexcept
+	{
+		return AllKernels[static_cast<int>(path)];
+	}
+}
\ No newline at end of file
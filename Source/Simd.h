@@ -0,0 +1,42 @@
+#pragma once
+
+// the synth's oscillators and the tuning tables run through kernels that are compiled
+// for several instruction sets. the widest one the cpu supports is picked once per process.
+// XEN_SIMD forces a path for testing: 0 detects (default), 1 scalar, 2 sse2, 3 avx2, 4 avx512.
+// a forced path the cpu lacks falls back to the next narrower one
+#ifndef XEN_SIMD
+	#define XEN_SIMD 0
+#endif
+
+namespace simd
+{
+	// scalar: the std:: functions, the reference for the others.
+	// baseline: the vectorised kernels for the build's own instruction set (sse2 on x64)
+	enum class Path { Scalar, Baseline, AVX2, AVX512, NumPaths };
+	static constexpr int NumPaths = static_cast<int>(Path::NumPaths);
+
+	struct Kernels
+	{
+		// dest, phase [-pi, pi], env, drive, gain, numSamples
+		// dest += tanh(drive * sin(phase)) * gain * env
+		void(*osc)(float*, const double*, const double*, double, double, int) noexcept;
+		// dest, phase [-pi, pi], env, gain, numSamples
+		// dest += sin(phase) * gain * env
+		void(*sine)(float*, const double*, const double*, double, int) noexcept;
+		// dest, exponents, scale, num
+		// dest = scale * 2^exponent
+		void(*exp2)(double*, const double*, double, int) noexcept;
+		Path path;
+	};
+
+	const char* getName(Path) noexcept;
+
+	// false if the cpu or the build lacks it
+	bool isSupported(Path) noexcept;
+
+	// the path of XEN_SIMD, or the widest supported one
+	const Kernels& getKernels() noexcept;
+
+	// only for supported paths
+	const Kernels& getKernels(Path) noexcept;
+}
\ No newline at end of file
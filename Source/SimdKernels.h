@@ -0,0 +1,80 @@
+// no include guard: Simd.cpp includes this once per instruction set, with
+// XEN_SIMD_NAMESPACE and XEN_SIMD_TARGET (the target attribute) defined.
+// the loops have no branches and no library calls, so the compiler vectorises
+// them for each target. sin, tanh and exp2 are polynomials, accurate to ~1e-13
+
+namespace XEN_SIMD_NAMESPACE
+{
+	// x [-1022, 1023]
+	// 2^round(x) is built in the exponent bits, times 2^fraction.
+	// no clamping: selects with constants keep gcc from vectorising the loop
+	XEN_SIMD_TARGET static inline double exp2(double x) noexcept
+	{
+		const auto t = x + RoundMagic;
+		const auto f = x - (t - RoundMagic);
+		const auto y = f * Ln2;
+		auto p = 1. / 479001600.;
+		p = p * y + 1. / 39916800.;
+		p = p * y + 1. / 3628800.;
+		p = p * y + 1. / 362880.;
+		p = p * y + 1. / 40320.;
+		p = p * y + 1. / 5040.;
+		p = p * y + 1. / 720.;
+		p = p * y + 1. / 120.;
+		p = p * y + 1. / 24.;
+		p = p * y + 1. / 6.;
+		p = p * y + .5;
+		p = p * y + 1.;
+		p = p * y + 1.;
+		std::uint64_t bits;
+		std::memcpy(&bits, &t, sizeof(bits));
+		bits = (bits - RoundMagicBits + 1023) << 52;
+		double scale;
+		std::memcpy(&scale, &bits, sizeof(scale));
+		return p * scale;
+	}
+
+	// x [-pi, pi]
+	XEN_SIMD_TARGET static inline double sin(double x) noexcept
+	{
+		// sin(x) = sin(pi - x) folds the range to [-pi/2, pi/2], without selects
+		x = std::copysign(math::Pi * .5 - std::abs(std::abs(x) - math::Pi * .5), x);
+		const auto x2 = x * x;
+		auto p = 1. / 355687428096000.;
+		p = p * x2 - 1. / 1307674368000.;
+		p = p * x2 + 1. / 6227020800.;
+		p = p * x2 - 1. / 39916800.;
+		p = p * x2 + 1. / 362880.;
+		p = p * x2 - 1. / 5040.;
+		p = p * x2 + 1. / 120.;
+		p = p * x2 - 1. / 6.;
+		return x + x * x2 * p;
+	}
+
+	// x [-350, 350]
+	XEN_SIMD_TARGET static inline double tanh(double x) noexcept
+	{
+		const auto e = exp2(x * TwoLog2e);
+		return (e - 1.) / (e + 1.);
+	}
+
+	XEN_SIMD_TARGET static void osc(float* dest, const double* phase, const double* env,
+		double drive, double gain, int numSamples) noexcept
+	{
+		for (auto i = 0; i < numSamples; ++i)
+			dest[i] += static_cast<float>(tanh(drive * sin(phase[i])) * gain * env[i]);
+	}
+
+	XEN_SIMD_TARGET static void sine(float* dest, const double* phase, const double* env,
+		double gain, int numSamples) noexcept
+	{
+		for (auto i = 0; i < numSamples; ++i)
+			dest[i] += static_cast<float>(sin(phase[i]) * gain * env[i]);
+	}
+
+	XEN_SIMD_TARGET static void exp2(double* dest, const double* exponents, double scale, int num) noexcept
+	{
+		for (auto i = 0; i < num; ++i)
+			dest[i] = scale * exp2(exponents[i]);
+	}
+}
\ No newline at end of file
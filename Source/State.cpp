@@ -0,0 +1,84 @@
+#include "State.h"
+
+namespace state
+{
+	static constexpr int Magic = 0x584e4553; // XENS
+	static constexpr int Version = 1;
+
+	void write(const Data& data, MemoryBlock& dest)
+	{
+		juce::MemoryOutputStream out(dest, false);
+		out.writeInt(Magic);
+		out.writeInt(Version);
+		out.writeCompressedInt(static_cast<int>(data.parameters.size()));
+		for (const auto& parameter : data.parameters)
+		{
+			out.writeString(parameter.id);
+			out.writeFloat(parameter.value);
+		}
+		out.writeBool(data.hasScale);
+		if (data.hasScale)
+		{
+			out.writeString(data.scale.name);
+			out.writeBool(data.scale.absolute);
+			out.writeCompressedInt(data.scale.size());
+			for (const auto cents : data.scale.cents)
+				out.writeDouble(cents);
+		}
+		out.writeBool(data.hasTable);
+		if (data.hasTable)
+			for (const auto freq : data.table)
+				out.writeDouble(freq);
+	}
+
+	bool read(Data& data, const void* src, int size)
+	{
+		juce::MemoryInputStream in(src, static_cast<size_t>(size), false);
+		const auto hasBytes = [&in](juce::int64 numBytes)
+		{
+			return in.getNumBytesRemaining() >= numBytes;
+		};
+		// newer versions are not understood, rather than half restored
+		if (!hasBytes(8) || in.readInt() != Magic)
+			return false;
+		if (in.readInt() != Version)
+			return false;
+		const auto numParameters = in.readCompressedInt();
+		if (numParameters < 0 || !hasBytes(static_cast<juce::int64>(numParameters) * 5))
+			return false;
+		data.parameters.resize(numParameters);
+		for (auto& parameter : data.parameters)
+		{
+			parameter.id = in.readString();
+			if (!hasBytes(4))
+				return false;
+			parameter.value = in.readFloat();
+		}
+		if (!hasBytes(1))
+			return false;
+		data.hasScale = in.readBool();
+		if (data.hasScale)
+		{
+			data.scale.name = in.readString();
+			if (!hasBytes(1))
+				return false;
+			data.scale.absolute = in.readBool();
+			const auto numCents = in.readCompressedInt();
+			if (numCents < 0 || !hasBytes(static_cast<juce::int64>(numCents) * 8))
+				return false;
+			data.scale.cents.resize(numCents);
+			for (auto& cents : data.scale.cents)
+				cents = in.readDouble();
+		}
+		if (!hasBytes(1))
+			return false;
+		data.hasTable = in.readBool();
+		if (!data.hasTable)
+			return true;
+		if (!hasBytes(NumPitches * 8))
+			return false;
+		for (auto& freq : data.table)
+			freq = in.readDouble();
+		return true;
+	}
+}
\ No newline at end of file
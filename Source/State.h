@@ -0,0 +1,46 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <vector>
+#include "Scala.h"
+
+namespace state
+{
+	using String = juce::String;
+	using MemoryBlock = juce::MemoryBlock;
+
+	static constexpr int NumPitches = 128;
+
+	struct Parameter
+	{
+		String id;
+		// denormalised
+		float value;
+	};
+
+	// everything a session needs to restore an instance without parsing or computing.
+	// the scale is embedded so that it can be found again if the library changed,
+	// the table is the frequency table of the tuning at the time of saving.
+	struct Data
+	{
+		Data() :
+			parameters(),
+			scale(),
+			hasScale(false),
+			table(),
+			hasTable(false)
+		{}
+
+		std::vector<Parameter> parameters;
+		scala::Scale scale;
+		bool hasScale;
+		double table[NumPitches];
+		bool hasTable;
+	};
+
+	// data, dest
+	void write(const Data&, MemoryBlock&);
+
+	// data, src, size
+	// false if this is not binary state, e.g. xml from an older version
+	bool read(Data&, const void*, int);
+}
\ No newline at end of file
@@ -0,0 +1,165 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "Quality.h"
+
+// always-on aggregate statistics of one instance. the audio thread is the only writer,
+// so it adds with a relaxed load and store instead of a locked read-modify-write.
+// any other thread can take a snapshot at any time, without locks.
+namespace stats
+{
+	enum class Counter
+	{
+		Blocks,
+		EventsIn,
+		EventsOut,
+		VoicesStolen,
+		// notes left out of an mts-esp publish because their tuning didn't change
+		NotesUnchanged,
+		MTSPublishes,
+		SysexRetunes,
+		TuningRecomputes,
+		// the synth's quality went down a tier under load
+		QualityStepDowns,
+		NumCounters
+	};
+
+	static constexpr int NumCounters = static_cast<int>(Counter::NumCounters);
+	// bucket i counts blocks that took [2^i, 2^(i+1)[ µs, the first and last are open
+	static constexpr int NumBuckets = 16;
+
+	inline const char* getName(Counter c) noexcept
+	{
+		static constexpr const char* Names[NumCounters] =
+		{
+			"blocks", "events in", "events out", "voices stolen",
+			"notes unchanged", "mts publishes", "sysex retunes", "tuning recomputes",
+			"quality step downs"
+		};
+		return Names[static_cast<int>(c)];
+	}
+
+	struct Snapshot
+	{
+		std::array<uint64_t, NumCounters> counters;
+		std::array<uint64_t, NumBuckets> histogram;
+		quality::Tier qualityTier;
+
+		uint64_t operator[](Counter c) const noexcept
+		{
+			return counters[static_cast<int>(c)];
+		}
+
+		// percentile [0,1]
+		// upper bound of the bucket that holds the percentile of block times in µs, 0 if empty
+		uint64_t getBlockTimeUs(double percentile) const noexcept
+		{
+			uint64_t total = 0;
+			for (const auto n : histogram)
+				total += n;
+			if (total == 0)
+				return 0;
+			const auto rank = static_cast<uint64_t>(percentile * static_cast<double>(total - 1));
+			uint64_t sum = 0;
+			for (auto i = 0; i < NumBuckets; ++i)
+			{
+				sum += histogram[i];
+				if (sum > rank)
+					return static_cast<uint64_t>(1) << (i + 1);
+			}
+			return static_cast<uint64_t>(1) << NumBuckets;
+		}
+
+		juce::var toVar() const
+		{
+			auto obj = new juce::DynamicObject();
+			for (auto i = 0; i < NumCounters; ++i)
+				obj->setProperty(getName(static_cast<Counter>(i)), static_cast<juce::int64>(counters[i]));
+			juce::Array<juce::var> buckets;
+			for (const auto n : histogram)
+				buckets.add(static_cast<juce::int64>(n));
+			obj->setProperty("blockTimeLog2UsHistogram", buckets);
+			obj->setProperty("blockP50Us", static_cast<juce::int64>(getBlockTimeUs(.5)));
+			obj->setProperty("blockP99Us", static_cast<juce::int64>(getBlockTimeUs(.99)));
+			obj->setProperty("qualityTier", quality::getName(qualityTier));
+			return obj;
+		}
+	};
+
+	class Registry
+	{
+	public:
+		Registry() :
+			counters(),
+			histogram(),
+			qualityTier(quality::Tier::Full),
+			id(nextId().fetch_add(1) + 1)
+		{
+			for (auto& c : counters)
+				c.store(0);
+			for (auto& b : histogram)
+				b.store(0);
+		}
+
+		// audio thread only
+		void add(Counter c, uint64_t n = 1) noexcept
+		{
+			increment(counters[static_cast<int>(c)], n);
+		}
+
+		// audio thread only
+		void addBlockTime(int64_t ns) noexcept
+		{
+			auto us = static_cast<uint64_t>(ns > 0 ? ns / 1000 : 0);
+			auto bucket = 0;
+			while (us > 1 && bucket < NumBuckets - 1)
+			{
+				us >>= 1;
+				++bucket;
+			}
+			increment(histogram[bucket], 1);
+		}
+
+		// audio thread only
+		void setQualityTier(quality::Tier tier) noexcept
+		{
+			qualityTier.store(tier, std::memory_order_relaxed);
+		}
+
+		Snapshot snapshot() const noexcept
+		{
+			Snapshot s;
+			for (auto i = 0; i < NumCounters; ++i)
+				s.counters[i] = counters[i].load(std::memory_order_relaxed);
+			for (auto i = 0; i < NumBuckets; ++i)
+				s.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+			s.qualityTier = qualityTier.load(std::memory_order_relaxed);
+			return s;
+		}
+
+		// unique per process, tells the dumps of several instances apart
+		int getId() const noexcept
+		{
+			return id;
+		}
+
+	private:
+		std::array<std::atomic<uint64_t>, NumCounters> counters;
+		std::array<std::atomic<uint64_t>, NumBuckets> histogram;
+		std::atomic<quality::Tier> qualityTier;
+		int id;
+
+		static void increment(std::atomic<uint64_t>& value, uint64_t n) noexcept
+		{
+			value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		static std::atomic<int>& nextId() noexcept
+		{
+			static std::atomic<int> next(0);
+			return next;
+		}
+	};
+}
\ No newline at end of file
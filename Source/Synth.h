@@ -1,8 +1,11 @@
 #pragma once
 #include <juce_events/juce_events.h>
+#include <algorithm>
 #include <functional>
 #include "MPESplit.h"
 #include "Math.h"
+#include "Quality.h"
+#include "Simd.h"
 #include "mts/Client/libMTSClient.h"
 
 namespace syn
@@ -10,12 +13,18 @@ namespace syn
 	using MPE = mpe::Split;
 	using MidiBuffer = juce::MidiBuffer;
 	using MidiMessage = juce::MidiMessage;
+	using Tier = quality::Tier;
 
 	class Voice
 	{
 		struct Osc
 		{
 			static constexpr double Gain = .2;
+			static constexpr double Drive = 4.;
+			// samples per envelope step at the control rate
+			static constexpr int EnvInterval = 32;
+			// below it a released voice counts as silent
+			static constexpr double SilentEnv = 1e-4;
 
 			Osc() :
 				phase(0.),
@@ -23,7 +32,10 @@ namespace syn
 				env(0.),
 				rise(0.),
 				fall(0.),
+				riseStep(0.),
+				fallStep(0.),
 				sampleRateInvTau(1.),
+				envSamplesLeft(0),
 				noteOn(false)
 			{}
 
@@ -32,45 +44,122 @@ namespace syn
 				sampleRateInvTau = math::Tau / sampleRate;
 				rise = 500. / sampleRate;
 				fall = 80. / sampleRate;
+				// the same curves, one step per EnvInterval samples
+				const auto interval = static_cast<double>(EnvInterval);
+				riseStep = 1. - std::pow(1. - rise, interval);
+				fallStep = 1. - std::pow(1. - fall, interval);
+				envSamplesLeft = 0;
 			}
 
+			// limited to the sample rate, which keeps the phase within [-pi, pi]
 			void setFreqHz(double freq) noexcept
 			{
-				inc = freq * sampleRateInvTau;
+				inc = std::min(freq * sampleRateInvTau, math::Tau);
 			}
 
-			double operator()() noexcept
+			// phases, envs, numSamples, controlRateEnv
+			// the recursive part of the oscillator. the kernels shape it
+			void advance(double* phases, double* envs, int numSamples, bool controlRateEnv) noexcept
 			{
-				phase += inc;
-				if (phase > math::Pi)
-					phase -= math::Tau;
-				const auto sine = std::sin(phase);
-				const auto saturated = std::tanh(4. * sine) * Gain;
+				for (auto i = 0; i < numSamples; ++i)
+				{
+					phase += inc;
+					if (phase > math::Pi)
+						phase -= math::Tau;
+					phases[i] = phase;
+				}
+				if (controlRateEnv)
+					return advanceEnvControlRate(envs, numSamples);
+				for (auto i = 0; i < numSamples; ++i)
+				{
+					if (noteOn)
+						env += rise * (1. - env);
+					else
+						env += fall * (0. - env);
+					envs[i] = env;
+				}
+			}
 
-				if (noteOn)
-					env += rise * (1. - env);
-				else
-					env += fall * (0. - env);
+			// numSamples
+			// keeps the envelope going at the control rate while the voice isn't rendered,
+			// so it doesn't come back with a stale level. the phase doesn't matter until then
+			void skip(int numSamples) noexcept
+			{
+				auto i = 0;
+				while (i < numSamples)
+				{
+					if (envSamplesLeft == 0)
+						stepEnv();
+					const auto n = std::min(envSamplesLeft, numSamples - i);
+					envSamplesLeft -= n;
+					i += n;
+				}
+			}
 
-				const auto y = saturated * env;
-				return y;
+			bool isSilent() const noexcept
+			{
+				return !noteOn && env < SilentEnv;
 			}
 
 		private:
-			double phase, inc, env, rise, fall, sampleRateInvTau;
+			double phase, inc, env, rise, fall, riseStep, fallStep, sampleRateInvTau;
+			int envSamplesLeft;
+
+			void stepEnv() noexcept
+			{
+				if (noteOn)
+					env += riseStep * (1. - env);
+				else
+					env += fallStep * (0. - env);
+				envSamplesLeft = EnvInterval;
+			}
+
+			// envs, numSamples
+			void advanceEnvControlRate(double* envs, int numSamples) noexcept
+			{
+				auto i = 0;
+				while (i < numSamples)
+				{
+					if (envSamplesLeft == 0)
+						stepEnv();
+					const auto n = std::min(envSamplesLeft, numSamples - i);
+					std::fill(envs + i, envs + i + n, env);
+					envSamplesLeft -= n;
+					i += n;
+				}
+			}
 		public:
 			bool noteOn;
 		};
 	public:
+		// samples per kernel call
+		static constexpr int ChunkSize = 64;
+
 		Voice() :
 			osc(),
+			kernels(&simd::getKernels(simd::Path::Scalar)),
+			tier(Tier::Full),
 			curNote(0)
 		{
 		}
 
-		void prepare(double sampleRate)
+		void setQuality(Tier _tier) noexcept
+		{
+			tier = _tier;
+		}
+
+		// midi
+		// false while silent and without events in the block
+		bool isActive(const MidiBuffer& midiIn) const noexcept
+		{
+			return !osc.isSilent() || !midiIn.isEmpty();
+		}
+
+		// sampleRate, kernels
+		void prepare(double sampleRate, const simd::Kernels& _kernels)
 		{
 			osc.prepare(sampleRate);
+			kernels = &_kernels;
 			curNote = 0;
 		}
 
@@ -79,17 +168,21 @@ namespace syn
 			osc.setFreqHz(freqTable[curNote]);
 		}
 
+		// smpls, midi, freqTable, start, end, render
+		// without render only the notes and the envelope are tracked
 		void synthMPE(float* smpls, const MidiBuffer& midiIn,
-			const double* freqTable, int numSamples) noexcept
+			const double* freqTable, int start, int end, bool render) noexcept
 		{
-			auto s = 0;
-			for (const auto it : midiIn)
+			auto s = start;
+			for (auto it = midiIn.findNextSamplePosition(start); it != midiIn.cend(); ++it)
 			{
-				const auto ts = it.samplePosition;
-				const auto msg = it.getMessage();
+				const auto ts = (*it).samplePosition;
+				if (ts >= end)
+					break;
+				const auto msg = (*it).getMessage();
 				if (msg.isNoteOnOrOff())
 				{
-					synthesize(smpls, s, ts);
+					synthesize(smpls, s, ts, render);
 					s = ts;
 					if (msg.isNoteOn())
 					{
@@ -102,60 +195,52 @@ namespace syn
 						osc.noteOn = false;
 				}
 			}
-			synthesize(smpls, s, numSamples);
-		}
-
-		void synthMTS(float* smpls, const MidiBuffer& midiIn,
-			MTSClient* client, int numSamples) noexcept
-		{
-			auto s = 0;
-			for (const auto it : midiIn)
-			{
-				const auto ts = it.samplePosition;
-				const auto msg = it.getMessage();
-				if (msg.isNoteOnOrOff())
-				{
-					synthesize(smpls, s, ts);
-					s = ts;
-					if (msg.isNoteOn())
-					{
-						curNote = msg.getNoteNumber();
-						auto freq = MTS_NoteToFrequency(client, static_cast<char>(curNote), static_cast<char>(-1));
-						osc.setFreqHz(freq);
-						osc.noteOn = true;
-					}
-					else if (msg.isNoteOff())
-						osc.noteOn = false;
-				}
-			}
-			synthesize(smpls, s, numSamples);
+			synthesize(smpls, s, end, render);
 		}
 	private:
 		Osc osc;
+		const simd::Kernels* kernels;
+		Tier tier;
 		int curNote;
 
-		void synthesize(float* smpls, int s, int ts) noexcept
+		// smpls, s, ts, render
+		void synthesize(float* smpls, int s, int ts, bool render) noexcept
 		{
+			if (!render)
+				return osc.skip(ts - s);
+			double phases[ChunkSize], envs[ChunkSize];
 			while (s < ts)
 			{
-				smpls[s] += static_cast<float>(osc());
-				++s;
+				const auto numSamples = std::min(ChunkSize, ts - s);
+				osc.advance(phases, envs, numSamples, tier >= Tier::ControlRateEnv);
+				if (tier >= Tier::CheapOsc)
+					kernels->sine(smpls + s, phases, envs, Osc::Gain, numSamples);
+				else
+					kernels->osc(smpls + s, phases, envs, Osc::Drive, Osc::Gain, numSamples);
+				s += numSamples;
 			}
 		}
 	};
 
 	struct Synth
 	{
+		// voices rendered from Tier::FewerVoices on
+		static constexpr int MaxReducedVoices = 4;
+
 		Synth(MPE& _mpe) :
-			mtsClient(MTS_RegisterClient()),
+			mtsClient(nullptr),
+			mtsTable(),
+			mtsVersion(0),
 			voices(),
-			mpe(_mpe)
+			mpe(_mpe),
+			tier(Tier::Full)
 		{
 		}
 
 		~Synth()
 		{
-			MTS_DeregisterClient(mtsClient);
+			if (mtsClient != nullptr)
+				MTS_DeregisterClient(mtsClient);
 		}
 
 		void update(const double* freqTable) noexcept
@@ -164,55 +249,111 @@ namespace syn
 				voice.update(freqTable);
 		}
 
-		void prepare(double sampleRate) noexcept
+		void setQuality(Tier _tier) noexcept
+		{
+			tier = _tier;
+			for (auto& voice : voices)
+				voice.setQuality(tier);
+		}
+
+		// the mts client connects to libMTS, so it is only registered once
+		// the plugin gets activated, not while hosts scan it
+		// sampleRate, kernels
+		void prepare(double sampleRate, const simd::Kernels& kernels)
 		{
+			if (mtsClient == nullptr)
+				mtsClient = MTS_RegisterClient();
 			for (auto& voice : voices)
-				voice.prepare(sampleRate);
+				voice.prepare(sampleRate, kernels);
+		}
+
+		// hands sysex (e.g. mts dumps from hardware) straight to the mts client,
+		// which retunes from it whenever no master is present. a dump split into packets,
+		// like in midi files, continues in events that start with f7.
+		// the client's parser keeps its state in between
+		void processSysex(const MidiBuffer& midi) noexcept
+		{
+			for (const auto it : midi)
+			{
+				if (it.numBytes == 0)
+					continue;
+				const auto status = it.data[0];
+				if (status == 0xf0)
+					MTS_ParseMIDIDataU(mtsClient, it.data, it.numBytes);
+				else if (status == 0xf7)
+				{
+					// a lone f7 ends the dump
+					const auto offset = it.numBytes > 1 ? 1 : 0;
+					MTS_ParseMIDIDataU(mtsClient, it.data + offset, it.numBytes - offset);
+				}
+			}
 		}
 
 		void synthMPE(float* const* samples, const double* freqTable, int numSamples) noexcept
 		{
-			clear(samples, numSamples);
+			synthMPE(samples, freqTable, 0, numSamples);
+		}
+
+		void synthMTS(float* const* samples, int numSamples) noexcept
+		{
+			synthMTS(samples, 0, numSamples);
+		}
+
+		// samples, freqTable, start, end
+		void synthMPE(float* const* samples, const double* freqTable, int start, int end) noexcept
+		{
+			clear(samples, start, end);
+			auto numRendered = 0;
 			for (auto ch = 0; ch < mpe::NumChannelsMPE; ++ch)
 			{
 				auto& voice = voices[ch];
 				const auto& midi = mpe[ch + 2];
+				auto render = tier < Tier::FewerVoices;
+				if (tier == Tier::FewerVoices && numRendered < MaxReducedVoices && voice.isActive(midi))
+				{
+					render = true;
+					++numRendered;
+				}
 				voice.synthMPE
 				(
-					samples[0], midi, freqTable, numSamples
+					samples[0], midi, freqTable, start, end, render
 				);
 			}
-			copy(samples, numSamples);
+			if (tier != Tier::SynthOff)
+				copy(samples, start, end);
 		}
 
-		void synthMTS(float* const* samples, int numSamples) noexcept
+		// samples, start, end
+		void synthMTS(float* const* samples, int start, int end) noexcept
 		{
-			clear(samples, numSamples);
-			for (auto ch = 0; ch < mpe::NumChannelsMPE; ++ch)
+			// the whole table is refetched only when the client reports a tuning change,
+			// which also retunes held notes
+			const auto version = MTS_GetTuningVersion(mtsClient);
+			if (mtsVersion != version)
 			{
-				auto& voice = voices[ch];
-				const auto& midi = mpe[ch + 2];
-				voice.synthMTS
-				(
-					samples[0], midi, mtsClient, numSamples
-				);
+				mtsVersion = version;
+				MTS_NoteToFrequencies(mtsClient, mtsTable.data(), static_cast<char>(-1));
+				update(mtsTable.data());
 			}
-			copy(samples, numSamples);
+			synthMPE(samples, mtsTable.data(), start, end);
 		}
 	private:
 		MTSClient* mtsClient;
+		std::array<double, 128> mtsTable;
+		unsigned int mtsVersion;
 		std::array<Voice, mpe::NumChannelsMPE> voices;
 		MPE& mpe;
+		Tier tier;
 
-		void clear(float* const* samples, int numSamples) noexcept
+		void clear(float* const* samples, int start, int end) noexcept
 		{
 			for(auto ch = 0; ch < 2; ++ch)
-				juce::FloatVectorOperations::clear(samples[ch], numSamples);
+				juce::FloatVectorOperations::clear(samples[ch] + start, end - start);
 		}
 
-		void copy(float* const* samples, int numSamples) noexcept
+		void copy(float* const* samples, int start, int end) noexcept
 		{
-			juce::FloatVectorOperations::copy(samples[1], samples[0], numSamples);
+			juce::FloatVectorOperations::copy(samples[1] + start, samples[0] + start, end - start);
 		}
 	};
 }
\ No newline at end of file
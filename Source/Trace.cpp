@@ -0,0 +1,221 @@
+#include "Trace.h"
+
+#if XEN_TRACE
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace trace
+{
+	static thread_local Ring* currentRing = nullptr;
+
+	int64_t nowNs() noexcept
+	{
+		const auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+	}
+
+	// drains all rings into one file per process, in the json array format of chrome traces
+	class Writer :
+		public juce::Thread
+	{
+		static constexpr int DrainIntervalMs = 50;
+	public:
+		Writer() :
+			Thread("Xen Trace Writer"),
+			mutex(),
+			rings(),
+			out(nullptr),
+			numRings(0),
+			numEvents(0)
+		{
+			startThread();
+		}
+
+		~Writer() override
+		{
+			stopThread(1000);
+			drain();
+			if (out == nullptr)
+				return;
+			*out << "\n]\n";
+			out->flush();
+		}
+
+		// returns the ring's id
+		int add(Ring* ring)
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			rings.push_back(ring);
+			return ++numRings;
+		}
+
+		void remove(Ring* ring)
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			drain(*ring);
+			rings.erase(std::remove(rings.begin(), rings.end(), ring), rings.end());
+		}
+
+		void run() override
+		{
+			while (!threadShouldExit())
+			{
+				wait(DrainIntervalMs);
+				drain();
+			}
+		}
+
+		static juce::File getFile()
+		{
+			const auto name = "xen-trace-" + juce::Time::getCurrentTime().formatted("%Y%m%d-%H%M%S") +
+				"-" + juce::String(juce::Process::getCurrentProcessId()) + ".json";
+			return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+				.getChildFile("Mrugalla").getChildFile("Xen").getChildFile("Traces").getChildFile(name)
+				.getNonexistentSibling();
+		}
+
+	private:
+		std::mutex mutex;
+		std::vector<Ring*> rings;
+		std::unique_ptr<juce::FileOutputStream> out;
+		int numRings;
+		juce::int64 numEvents;
+
+		void drain()
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			for (auto ring : rings)
+				drain(*ring);
+			if (out != nullptr)
+				out->flush();
+		}
+
+		void drain(Ring& ring)
+		{
+			Event event;
+			while (ring.pop(event))
+			{
+				if (!open())
+					continue;
+				const auto tid = juce::String(ring.getId());
+				*out << (numEvents++ == 0 ? "\n" : ",\n") << "{\"name\":\"" << event.name
+					<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+					<< ",\"ts\":" << juce::String(static_cast<double>(event.beginNs) * 1e-3, 3)
+					<< ",\"dur\":" << juce::String(static_cast<double>(event.endNs - event.beginNs) * 1e-3, 3) << "}";
+			}
+		}
+
+		bool open()
+		{
+			if (out != nullptr)
+				return true;
+			const auto file = getFile();
+			if (file.getParentDirectory().createDirectory().failed())
+				return false;
+			out = std::make_unique<juce::FileOutputStream>(file);
+			if (!out->openedOk())
+			{
+				out.reset();
+				return false;
+			}
+			*out << "[";
+			return true;
+		}
+	};
+
+	static std::shared_ptr<Writer> getWriter()
+	{
+		static std::mutex mutex;
+		static std::weak_ptr<Writer> shared;
+		const std::lock_guard<std::mutex> lock(mutex);
+		auto writer = shared.lock();
+		if (writer == nullptr)
+		{
+			writer = std::make_shared<Writer>();
+			shared = writer;
+		}
+		return writer;
+	}
+
+	// Ring
+
+	Ring::Ring() :
+		events(),
+		head(0),
+		tail(0),
+		numDropped(0),
+		id(0),
+		writer(getWriter())
+	{
+		id = writer->add(this);
+	}
+
+	Ring::~Ring()
+	{
+		writer->remove(this);
+	}
+
+	bool Ring::push(const Event& event) noexcept
+	{
+		const auto h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == Capacity)
+		{
+			numDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		events[h % Capacity] = event;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Ring::pop(Event& event) noexcept
+	{
+		const auto t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return false;
+		event = events[t % Capacity];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	int Ring::getId() const noexcept
+	{
+		return id;
+	}
+
+	uint32_t Ring::getNumDropped() const noexcept
+	{
+		return numDropped.load(std::memory_order_relaxed);
+	}
+
+	// Block
+
+	Block::Block(Ring& ring) noexcept :
+		previous(currentRing)
+	{
+		currentRing = &ring;
+	}
+
+	Block::~Block()
+	{
+		currentRing = previous;
+	}
+
+	// Scope
+
+	Scope::Scope(const char* _name) noexcept :
+		name(_name),
+		beginNs(nowNs())
+	{
+	}
+
+	Scope::~Scope()
+	{
+		if (currentRing != nullptr)
+			currentRing->push({ name, beginNs, nowNs() });
+	}
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+// scoped trace points of the audio thread, exported as chrome trace json (also opens in perfetto).
+// compiled out unless XEN_TRACE is 1, the macros expand to nothing then
+#ifndef XEN_TRACE
+	#define XEN_TRACE 0
+#endif
+
+#if XEN_TRACE
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace trace
+{
+	struct Event
+	{
+		// string literal
+		const char* name;
+		int64_t beginNs, endNs;
+	};
+
+	class Writer;
+
+	int64_t nowNs() noexcept;
+
+	// one per instance. its audio thread is the only producer and the writer thread
+	// the only consumer, so neither side ever waits. events that don't fit are dropped.
+	class Ring
+	{
+	public:
+		static constexpr uint32_t Capacity = 1 << 12;
+
+		Ring();
+
+		~Ring();
+
+		bool push(const Event&) noexcept;
+
+		bool pop(Event&) noexcept;
+
+		int getId() const noexcept;
+
+		uint32_t getNumDropped() const noexcept;
+
+	private:
+		std::array<Event, Capacity> events;
+		std::atomic<uint32_t> head, tail, numDropped;
+		int id;
+		std::shared_ptr<Writer> writer;
+	};
+
+	// makes the trace points on this thread write into an instance's ring
+	class Block
+	{
+	public:
+		Block(Ring&) noexcept;
+
+		~Block();
+
+	private:
+		Ring* previous;
+	};
+
+	class Scope
+	{
+	public:
+		// string literal
+		Scope(const char*) noexcept;
+
+		~Scope();
+
+	private:
+		const char* name;
+		int64_t beginNs;
+	};
+}
+
+#define XEN_TRACE_JOIN2(a, b) a##b
+#define XEN_TRACE_JOIN(a, b) XEN_TRACE_JOIN2(a, b)
+#define XEN_TRACE_BLOCK(ring) const trace::Block XEN_TRACE_JOIN(xenTraceBlock, __LINE__)(ring)
+#define XEN_TRACE_SCOPE(name) const trace::Scope XEN_TRACE_JOIN(xenTraceScope, __LINE__)(name)
+#else
+#define XEN_TRACE_BLOCK(ring)
+#define XEN_TRACE_SCOPE(name)
+#endif
\ No newline at end of file
@@ -0,0 +1,390 @@
+#include "TuningBus.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#if XEN_TUNING_BUS
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace xen
+{
+	int64_t TuningBus::nowNs() noexcept
+	{
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return static_cast<int64_t>(ts.tv_sec) * 1000000000 + static_cast<int64_t>(ts.tv_nsec);
+	}
+
+#if XEN_TUNING_BUS
+	// set by usePrivateBus
+	static char privateName[TuningBus::MaxSegmentNameSize] = {};
+
+	static const char* getSegmentName() noexcept
+	{
+		return privateName[0] != '\0' ? privateName : TuningBus::SegmentName;
+	}
+
+	// writable, inode
+	// only writers create the segment. readers skip one that is too small, e.g. from an older layout
+	static TuningBus::Segment* mapSegment(bool writable, uint64_t& inode) noexcept
+	{
+		const auto fd = writable ?
+			shm_open(getSegmentName(), O_CREAT | O_RDWR, 0600) :
+			shm_open(getSegmentName(), O_RDONLY, 0);
+		if (fd < 0)
+			return nullptr;
+		const auto size = static_cast<off_t>(sizeof(TuningBus::Segment));
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (st.st_size < size && (!writable || ftruncate(fd, size) != 0)))
+		{
+			close(fd);
+			return nullptr;
+		}
+		inode = static_cast<uint64_t>(st.st_ino);
+		const auto protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+		auto data = mmap(nullptr, sizeof(TuningBus::Segment), protection, MAP_SHARED, fd, 0);
+		close(fd);
+		return data == MAP_FAILED ? nullptr : static_cast<TuningBus::Segment*>(data);
+	}
+
+	static void unmapSegment(const TuningBus::Segment* segment) noexcept
+	{
+		if (segment != nullptr)
+			munmap(const_cast<TuningBus::Segment*>(segment), sizeof(TuningBus::Segment));
+	}
+
+	static void removeSegment() noexcept
+	{
+		shm_unlink(getSegmentName());
+	}
+
+	// false if the segment was removed or replaced since it was mapped
+	static bool isCurrent(uint64_t inode) noexcept
+	{
+		const auto fd = shm_open(getSegmentName(), O_RDONLY, 0);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		const auto isSame = fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_ino) == inode;
+		close(fd);
+		return isSame;
+	}
+
+	// the pid only tells for writers in this pid namespace, the heartbeat for all
+	static bool isAlive(const TuningBus::Segment& segment, uint64_t owner) noexcept
+	{
+		if (TuningBus::nowNs() - segment.heartbeatNs.load() >= TuningBus::HeartbeatTimeoutNs)
+			return false;
+		const auto pid = static_cast<pid_t>(owner >> 32);
+		return pid == getpid() || kill(pid, 0) == 0 || errno != ESRCH;
+	}
+
+	static uint64_t makeWriterId() noexcept
+	{
+		static std::atomic<uint32_t> numWriters(0);
+		const auto pid = static_cast<uint64_t>(getpid());
+		return (pid << 32) | static_cast<uint64_t>(numWriters.fetch_add(1) + 1);
+	}
+#else
+	static TuningBus::Segment* mapSegment(bool, uint64_t&) noexcept
+	{
+		return nullptr;
+	}
+
+	static void unmapSegment(const TuningBus::Segment*) noexcept
+	{
+	}
+
+	static void removeSegment() noexcept
+	{
+	}
+
+	static bool isCurrent(uint64_t) noexcept
+	{
+		return true;
+	}
+
+	static bool isAlive(const TuningBus::Segment&, uint64_t) noexcept
+	{
+		return true;
+	}
+
+	static uint64_t makeWriterId() noexcept
+	{
+		return 0;
+	}
+#endif
+
+	void TuningBus::usePrivateBus() noexcept
+	{
+	#if XEN_TUNING_BUS
+		std::snprintf(privateName, sizeof(privateName), "%s-%d", SegmentName, static_cast<int>(getpid()));
+	#endif
+	}
+
+	// Clients
+
+#if XEN_TUNING_BUS
+	// constructed by connectClients, so it maps nothing before the plugin is prepared
+	static TuningBus::Reader& getClientReader()
+	{
+		static TuningBus::Reader reader;
+		return reader;
+	}
+
+	static unsigned long long getClientVersion()
+	{
+		auto& reader = getClientReader();
+		return reader.hasWriter() ? reader.getVersion() : 0;
+	}
+
+	static bool readClientTuning(MTSFallbackTuning* tuning)
+	{
+		return getClientReader().read(*tuning);
+	}
+#endif
+
+	void TuningBus::connectClients() noexcept
+	{
+	#if XEN_TUNING_BUS
+		static const MTSClientFallback fallback = { getClientVersion, readClientTuning };
+		getClientReader();
+		MTS_SetClientFallback(&fallback);
+	#endif
+	}
+
+	void TuningBus::checkClients() noexcept
+	{
+	#if XEN_TUNING_BUS
+		getClientReader().reconnect();
+	#endif
+	}
+
+	// Writer
+
+	TuningBus::Writer::Writer() :
+		segment(nullptr),
+		retired(nullptr),
+		inode(0),
+		id(makeWriterId()),
+		goneOwner(0)
+	{
+	}
+
+	TuningBus::Writer::~Writer()
+	{
+		unmapSegment(retired);
+		auto s = segment.load();
+		if (s == nullptr)
+			return;
+		// the last owner removes the bus. readers keep their mapping, writers still waiting create a new one
+		auto expected = id;
+		const auto wasOwner = s->owner.compare_exchange_strong(expected, 0);
+		if (wasOwner && isCurrent(inode))
+			removeSegment();
+		unmapSegment(s);
+	}
+
+	void TuningBus::Writer::open() noexcept
+	{
+		if (segment.load() == nullptr)
+			segment.store(mapSegment(true, inode));
+	}
+
+	bool TuningBus::Writer::publish(const double* table, const double (*channelTables)[NumPitches],
+		int numChannels, double periodRatio, char mapSize, char refKey, char mapStartKey,
+		const char* name) noexcept
+	{
+		if (segment.load() == nullptr || !acquire())
+			return false;
+		auto s = segment.load();
+
+		const auto sequence = s->sequence.load(std::memory_order_relaxed);
+		s->sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		s->magic = Magic;
+		s->layoutVersion = LayoutVersion;
+		auto& tuning = s->tuning;
+		tuning.periodRatio = periodRatio;
+		tuning.channelsUsed = 0;
+		for (auto ch = 0; ch < std::min(numChannels, static_cast<int>(NumChannels)); ++ch)
+		{
+			tuning.channelsUsed |= 1 << ch;
+			std::memcpy(tuning.channelTables[ch], channelTables[ch], sizeof(tuning.channelTables[ch]));
+		}
+		tuning.mapSize = mapSize;
+		tuning.refKey = refKey;
+		tuning.mapStartKey = mapStartKey;
+		std::strncpy(tuning.name, name, NameSize - 1);
+		tuning.name[NameSize - 1] = '\0';
+		std::memcpy(tuning.table, table, sizeof(tuning.table));
+
+		const auto now = nowNs();
+		s->publishTimeNs.store(now, std::memory_order_relaxed);
+		s->heartbeatNs.store(now, std::memory_order_relaxed);
+		s->sequence.store(sequence + 2, std::memory_order_release);
+		return true;
+	}
+
+	bool TuningBus::Writer::isOwner() const noexcept
+	{
+		const auto s = segment.load();
+		return s != nullptr && s->owner.load() == id;
+	}
+
+	bool TuningBus::Writer::isAvailable() noexcept
+	{
+		auto s = segment.load();
+		if (s == nullptr)
+			return false;
+		if (!isCurrent(inode))
+		{
+			auto expected = id;
+			s->owner.compare_exchange_strong(expected, 0);
+			uint64_t newInode = 0;
+			auto remapped = mapSegment(true, newInode);
+			if (remapped == nullptr)
+				return false;
+			unmapSegment(retired);
+			retired = s;
+			inode = newInode;
+			segment.store(remapped);
+			s = remapped;
+		}
+		const auto owner = s->owner.load();
+		const auto isGone = owner != 0 && owner != id && !isAlive(*s, owner);
+		goneOwner.store(isGone ? owner : 0);
+		return owner == 0 || isGone;
+	}
+
+	void TuningBus::Writer::beat() noexcept
+	{
+		const auto s = segment.load();
+		if (s != nullptr && s->owner.load() == id)
+			s->heartbeatNs.store(nowNs());
+	}
+
+	void TuningBus::Writer::release() noexcept
+	{
+		const auto s = segment.load();
+		if (s == nullptr)
+			return;
+		auto expected = id;
+		s->owner.compare_exchange_strong(expected, 0);
+	}
+
+	bool TuningBus::Writer::acquire() noexcept
+	{
+		auto s = segment.load();
+		auto owner = s->owner.load();
+		if (owner == id)
+			return true;
+		if (owner != 0 && owner != goneOwner.load())
+			return false;
+		if (!s->owner.compare_exchange_strong(owner, id))
+			return false;
+		s->heartbeatNs.store(nowNs());
+		return true;
+	}
+
+	// Reader
+
+	TuningBus::Reader::Reader() :
+		segment(nullptr),
+		retired(nullptr),
+		inode(0),
+		lastVersion(0),
+		latencyNs(0)
+	{
+		segment.store(mapSegment(false, inode));
+	}
+
+	TuningBus::Reader::~Reader()
+	{
+		unmapSegment(retired);
+		unmapSegment(segment.load());
+	}
+
+	void TuningBus::Reader::reconnect() noexcept
+	{
+		const auto s = segment.load();
+		if (s != nullptr && isCurrent(inode))
+			return;
+		uint64_t newInode = 0;
+		const auto remapped = mapSegment(false, newInode);
+		if (remapped == nullptr)
+			return;
+		unmapSegment(retired);
+		retired = s;
+		inode = newInode;
+		segment.store(remapped);
+	}
+
+	bool TuningBus::Reader::hasWriter() const noexcept
+	{
+		const auto s = segment.load(std::memory_order_acquire);
+		return s != nullptr && s->owner.load(std::memory_order_relaxed) != 0 &&
+			nowNs() - s->heartbeatNs.load(std::memory_order_relaxed) < HeartbeatTimeoutNs;
+	}
+
+	uint64_t TuningBus::Reader::getVersion() const noexcept
+	{
+		const auto s = segment.load(std::memory_order_acquire);
+		return s == nullptr ? 0 : s->sequence.load(std::memory_order_acquire) >> 1;
+	}
+
+	bool TuningBus::Reader::read(Tuning& tuning) noexcept
+	{
+		const auto s = segment.load(std::memory_order_acquire);
+		if (s == nullptr)
+			return false;
+		for (auto i = 0; i < MaxReadAttempts; ++i)
+		{
+			const auto sequence = s->sequence.load(std::memory_order_acquire);
+			if (sequence == 0 || (sequence & 1) != 0)
+				continue;
+			const auto publishTimeNs = s->publishTimeNs.load(std::memory_order_relaxed);
+			std::memcpy(&tuning, &s->tuning, sizeof(Tuning));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (s->sequence.load(std::memory_order_relaxed) != sequence)
+				continue;
+			if (s->magic != Magic || s->layoutVersion != LayoutVersion)
+				return false;
+			noteVersion(sequence >> 1, publishTimeNs);
+			return true;
+		}
+		return false;
+	}
+
+	void TuningBus::Reader::poll() noexcept
+	{
+		const auto s = segment.load(std::memory_order_acquire);
+		if (s == nullptr)
+			return;
+		const auto sequence = s->sequence.load(std::memory_order_acquire);
+		if (sequence == 0 || (sequence & 1) != 0)
+			return;
+		noteVersion(sequence >> 1, s->publishTimeNs.load(std::memory_order_relaxed));
+	}
+
+	int64_t TuningBus::Reader::getLatencyNs() const noexcept
+	{
+		return latencyNs.load(std::memory_order_relaxed);
+	}
+
+	void TuningBus::Reader::noteVersion(uint64_t version, int64_t publishTimeNs) noexcept
+	{
+		if (lastVersion.load(std::memory_order_relaxed) == version)
+			return;
+		if (lastVersion.exchange(version, std::memory_order_relaxed) != version)
+			latencyNs.store(nowNs() - publishTimeNs, std::memory_order_relaxed);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "mts/Client/libMTSClient.h"
+
+// the bus needs posix shared memory and changes what every mts client in the process
+// reads when libMTS is missing, so it is only built when asked for, e.g. on linux
+#ifndef XEN_TUNING_BUS
+	#define XEN_TUNING_BUS 0
+#endif
+
+namespace xen
+{
+	// open stand-in for the mts-esp shared tables: a posix shared memory segment that
+	// one writer (a xen instance in mts-esp mode) updates under a seqlock, and that any
+	// number of readers in any process copy from. readers never block the writer,
+	// they retry when they catch it mid-update and give up after MaxReadAttempts.
+	// the owner keeps a heartbeat, so readers in any process notice a crashed writer.
+	// the vendored mts client reads it through its fallback hook when libMTS is missing,
+	// each client from its own copy.
+	struct TuningBus
+	{
+		static constexpr const char* SegmentName = "/xen-tuning-bus";
+		// the segment name with a pid appended
+		static constexpr int MaxSegmentNameSize = 64;
+		static constexpr uint32_t Magic = 0x58544255;
+		// 2: heartbeat, the tuning is the mts client's fallback tuning
+		static constexpr uint32_t LayoutVersion = 2;
+		static constexpr int NumPitches = 128;
+		static constexpr int NumChannels = 16;
+		static constexpr int NameSize = 64;
+		static constexpr int MaxReadAttempts = 16;
+		// a writer that didn't beat for this long is gone, e.g. crashed
+		static constexpr int64_t HeartbeatTimeoutNs = 2000000000;
+
+		using Tuning = MTSFallbackTuning;
+
+		struct Segment
+		{
+			uint32_t magic, layoutVersion;
+			// pid << 32 | instance id of the writer, 0 if none
+			std::atomic<uint64_t> owner;
+			// odd while the writer is updating, advances by 2 per publish
+			std::atomic<uint64_t> sequence;
+			// CLOCK_MONOTONIC nanoseconds of the last publish, and of the owner's last sign of life
+			std::atomic<int64_t> publishTimeNs, heartbeatNs;
+			Tuning tuning;
+		};
+
+		static_assert(std::atomic<uint64_t>::is_always_lock_free, "the bus needs lock-free 64 bit atomics");
+		static_assert(sizeof(Tuning::name) == NameSize, "the name must fit the client's");
+
+		static int64_t nowNs() noexcept;
+
+		// gives this process a bus of its own, named after its pid, so that e.g. tools
+		// neither read nor take over the bus of a host. before any writer or reader exists
+		static void usePrivateBus() noexcept;
+
+		// makes the bus the mts client's fallback for when libMTS is missing.
+		// before the first client registers, not on the audio thread
+		static void connectClients() noexcept;
+
+		// not on the audio thread. maps the bus for the clients if a writer created
+		// or replaced it since, e.g. after the last owner removed it
+		static void checkClients() noexcept;
+
+		class Writer
+		{
+		public:
+			Writer();
+
+			~Writer();
+
+			// maps the segment, creating it if needed. until then the writer publishes nothing
+			void open() noexcept;
+
+			// table, channelTables, numChannels, periodRatio, mapSize, refKey, mapStartKey, name
+			// publishes if this writer owns the bus, nobody does, or isAvailable found the owner gone.
+			// it never asks whether the owner is alive itself, that takes syscalls
+			bool publish(const double*, const double (*)[NumPitches], int,
+				double, char, char, char, const char*) noexcept;
+
+			bool isOwner() const noexcept;
+
+			// not on the audio thread. no live writer owns the bus, so the next publish will take it over.
+			// remaps the bus if the last owner removed it
+			bool isAvailable() noexcept;
+
+			// not on the audio thread. the owner's sign of life, without it readers go offline
+			void beat() noexcept;
+
+			// gives up owning the bus, so that another writer can take over right away
+			void release() noexcept;
+
+		private:
+			std::atomic<Segment*> segment;
+			// the mapping before the last remap, unmapped on the next one when no publish can still use it
+			Segment* retired;
+			uint64_t inode;
+			uint64_t id;
+			// the owner that isAvailable found gone, 0 if none
+			std::atomic<uint64_t> goneOwner;
+
+			bool acquire() noexcept;
+		};
+
+		class Reader
+		{
+		public:
+			// maps the bus if it exists. readers never create it
+			Reader();
+
+			~Reader();
+
+			// not on the audio thread. maps the bus if it appeared or was replaced since
+			void reconnect() noexcept;
+
+			// a live writer owns the bus
+			bool hasWriter() const noexcept;
+
+			// advances with every publish
+			uint64_t getVersion() const noexcept;
+
+			// copies a consistent tuning. false if there is none yet or the writer stayed busy
+			bool read(Tuning&) noexcept;
+
+			// notices new publishes and measures how long they took to become visible
+			void poll() noexcept;
+
+			// nanoseconds from the last publish until a read or poll first saw it
+			int64_t getLatencyNs() const noexcept;
+
+		private:
+			std::atomic<const Segment*> segment;
+			// the mapping before the last reconnect, unmapped on the next one when no read can still use it
+			const Segment* retired;
+			uint64_t inode;
+			std::atomic<uint64_t> lastVersion;
+			std::atomic<int64_t> latencyNs;
+
+			void noteVersion(uint64_t, int64_t) noexcept;
+		};
+	};
+}
\ No newline at end of file
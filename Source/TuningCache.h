@@ -0,0 +1,273 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include "Scala.h"
+
+namespace xen
+{
+	struct TuningKey
+	{
+		double xen, anchorFreq;
+		const scala::Scale* scale;
+		bool stepsIn12;
+
+		bool operator==(const TuningKey& other) const noexcept
+		{
+			return xen == other.xen &&
+				anchorFreq == other.anchorFreq &&
+				scale == other.scale &&
+				stepsIn12 == other.stepsIn12;
+		}
+	};
+
+	// process-wide cache of immutable frequency tables, shared by all xen instances
+	// through a SharedResourcePointer. instances with the same tuning hold the same
+	// table, which is computed only once. lookups and releases are lock-free:
+	// an entry's reference count is negative while it is being (re)written,
+	// so other threads skip it instead of waiting.
+	// the cache grows by a segment of entries per InstancesPerSegment instances, off the audio thread.
+	// segments are never freed while the cache lives, so handles stay valid as it grows
+	template<int NumTables, int EntriesPerSegment, int InstancesPerSegment>
+	struct TuningTableCache
+	{
+		static constexpr int NumPitches = 128;
+		static constexpr int TableSize = NumTables * NumPitches;
+		static constexpr int MaxSegments = 256;
+		// slots searched per key, starting at its hash
+		static constexpr int MaxProbes = 16;
+
+		using Key = TuningKey;
+
+		struct Stats
+		{
+			int hits, misses, entriesInUse, entriesCached;
+			size_t bytes;
+		};
+
+	private:
+		static constexpr int Locked = std::numeric_limits<int>::min() / 2;
+
+		struct Entry
+		{
+			Entry() :
+				refs(0),
+				used(false),
+				key(),
+				table()
+			{}
+
+			std::atomic<int> refs;
+			std::atomic<bool> used;
+			Key key;
+			double table[TableSize];
+		};
+
+		using Segment = std::array<Entry, EntriesPerSegment>;
+
+	public:
+		// keeps one table alive, released on destruction
+		class Handle
+		{
+		public:
+			Handle() noexcept :
+				entry(nullptr)
+			{}
+
+			Handle(Handle&& other) noexcept :
+				entry(other.entry)
+			{
+				other.entry = nullptr;
+			}
+
+			Handle& operator=(Handle&& other) noexcept
+			{
+				if (this != &other)
+				{
+					reset();
+					entry = other.entry;
+					other.entry = nullptr;
+				}
+				return *this;
+			}
+
+			~Handle()
+			{
+				reset();
+			}
+
+			// nullptr if the cache had no room
+			const double* data() const noexcept
+			{
+				return entry == nullptr ? nullptr : entry->table;
+			}
+
+			// the tables of 128 pitches one after another, nullptr if the cache had no room
+			const double (*tables() const noexcept)[NumPitches]
+			{
+				return reinterpret_cast<const double(*)[NumPitches]>(data());
+			}
+
+			void reset() noexcept
+			{
+				if (entry != nullptr)
+					entry->refs.fetch_sub(1);
+				entry = nullptr;
+			}
+
+		private:
+			friend struct TuningTableCache;
+			Entry* entry;
+
+			Handle(Entry* _entry) noexcept :
+				entry(_entry)
+			{}
+		};
+
+		TuningTableCache() :
+			mutex(),
+			segments(),
+			numSegments(0),
+			numInstances(0),
+			hits(0),
+			misses(0)
+		{}
+
+		// not on the audio thread, grows the cache if this instance needs room
+		void addInstance()
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			++numInstances;
+			const auto needed = std::min((numInstances + InstancesPerSegment - 1) / InstancesPerSegment, MaxSegments);
+			auto n = numSegments.load();
+			for (; n < needed; ++n)
+				segments[n] = std::make_unique<Segment>();
+			numSegments.store(n);
+		}
+
+		// the room stays, entries held by other instances might live in it
+		void removeInstance()
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			--numInstances;
+		}
+
+		// key, fill(double* table)
+		// fill computes the table on a miss. returns an empty handle if
+		// all slots of this key are held by other tunings
+		template<typename Fill>
+		Handle acquire(const Key& key, const Fill& fill)
+		{
+			const auto capacity = getCapacity();
+			if (capacity == 0)
+				return Handle();
+			const auto numProbes = std::min(MaxProbes, capacity);
+			const auto start = hash(key) % static_cast<size_t>(capacity);
+			for (auto i = 0; i < numProbes; ++i)
+			{
+				auto& entry = getEntry((start + i) % capacity);
+				if (entry.refs.fetch_add(1) >= 0 && entry.used && entry.key == key)
+				{
+					hits.fetch_add(1);
+					return Handle(&entry);
+				}
+				entry.refs.fetch_sub(1);
+			}
+
+			misses.fetch_add(1);
+			// empty slots first, then ones no instance holds anymore
+			for (auto pass = 0; pass < 2; ++pass)
+				for (auto i = 0; i < numProbes; ++i)
+				{
+					auto& entry = getEntry((start + i) % capacity);
+					auto expected = 0;
+					if (!entry.refs.compare_exchange_strong(expected, Locked))
+						continue;
+					if (pass == 0 && entry.used)
+					{
+						entry.refs.fetch_sub(Locked);
+						continue;
+					}
+					entry.key = key;
+					entry.used.store(true);
+					fill(entry.table);
+					entry.refs.fetch_add(1 - Locked);
+					return Handle(&entry);
+				}
+			return Handle();
+		}
+
+		// key, table
+		// copies a cached table without computing it on a miss
+		bool copy(const Key& key, double* table) noexcept
+		{
+			const auto capacity = getCapacity();
+			const auto numProbes = std::min(MaxProbes, capacity);
+			const auto start = capacity == 0 ? 0 : hash(key) % static_cast<size_t>(capacity);
+			for (auto i = 0; i < numProbes; ++i)
+			{
+				auto& entry = getEntry((start + i) % capacity);
+				const auto isHit = entry.refs.fetch_add(1) >= 0 && entry.used && entry.key == key;
+				if (isHit)
+					std::copy(entry.table, entry.table + TableSize, table);
+				entry.refs.fetch_sub(1);
+				if (isHit)
+					return true;
+			}
+			return false;
+		}
+
+		Stats getStats() const noexcept
+		{
+			const auto n = numSegments.load();
+			const auto bytes = sizeof(TuningTableCache) + static_cast<size_t>(n) * sizeof(Segment);
+			Stats stats{ hits.load(), misses.load(), 0, 0, bytes };
+			for (auto s = 0; s < n; ++s)
+				for (const auto& entry : *segments[s])
+				{
+					const auto refs = entry.refs.load();
+					if (refs > 0)
+						++stats.entriesInUse;
+					else if (refs == 0 && entry.used)
+						++stats.entriesCached;
+				}
+			return stats;
+		}
+
+	private:
+		std::mutex mutex;
+		std::array<std::unique_ptr<Segment>, MaxSegments> segments;
+		// published after the segments it counts are allocated
+		std::atomic<int> numSegments;
+		int numInstances;
+		std::atomic<int> hits, misses;
+
+		int getCapacity() const noexcept
+		{
+			return numSegments.load() * EntriesPerSegment;
+		}
+
+		Entry& getEntry(size_t i) noexcept
+		{
+			return (*segments[i / EntriesPerSegment])[i % EntriesPerSegment];
+		}
+
+		static size_t hash(const Key& key) noexcept
+		{
+			auto h = std::hash<double>()(key.xen);
+			h = h * 31 + std::hash<double>()(key.anchorFreq);
+			h = h * 31 + std::hash<const void*>()(key.scale);
+			return h * 31 + (key.stepsIn12 ? 1 : 0);
+		}
+	};
+
+	// the table of each tuning, a few entries per instance
+	using TuningCache = TuningTableCache<1, 16, 4>;
+	// multi-channel mts-esp tables, only the master of each process publishes them
+	using ChannelTableCache = TuningTableCache<16, 2, 16>;
+}
\ No newline at end of file
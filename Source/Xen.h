@@ -1,72 +1,178 @@
 #pragma once
 #include <juce_core/juce_core.h>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
 #include <functional>
-#include "mts/Master/libMTSMaster.h"
 #include "Axiom.h"
 #include "Math.h"
+#include "Modulation.h"
 #include "MPESplit.h"
+#include "MTSMaster.h"
+#include "MTSPublisher.h"
+#include "MTSSysex.h"
+#include "Scala.h"
+#include "Simd.h"
+#include "Stats.h"
 #include "Synth.h"
+#include "TuningBus.h"
+#include "TuningCache.h"
+#include "Trace.h"
 #include "XenRescaler.h"
 
 namespace xen
 {
-	using Timer = juce::Timer;
+	// mpe: rescales midi to mpe, sysex: retunes the receiver via mts sysex, mts-esp: publishes as master.
+	// mts-esp is last, so that it stays at the normalised 1 of the old on/off parameter
+	enum class Mode { MPE, SysEx, MTSESP, NumModes };
 
 	struct Xen :
-		public Timer
+		public MTSMaster::Listener
 	{
 		static constexpr int NumPitches = 128;
-		using String = juce::String;
+		static constexpr int NumChannels = 16;
+		// range covered by the multi-channel table
+		static constexpr double MultiChannelOctaves = 10.;
+		// while modulating, exact tables are computed at the control rate
+		// and interpolated every UpdateInterval samples in between
+		static constexpr double ControlRateHz = 100.;
+		static constexpr int UpdateInterval = 32;
+		static constexpr double MaxMTSRateHz = 25.;
+		// tunings that last shorter than this are part of a sweep and aren't cached
+		static constexpr double SweepSeconds = .1;
+		// midi reserved per buffer in prepare
+		static constexpr int MidiBufferBytes = 2048;
 		using Midi = juce::MidiBuffer;
 
-		Xen(mpe::Split& mpeSplit) :
-			Timer(),
-			freqTable(),
+		// mpeSplit, statistics
+		Xen(mpe::Split& mpeSplit, stats::Registry& _statistics) :
+			tuningCache(),
+			channelTableCache(),
+			tuning(),
+			channels(),
+			preloaded(),
+			numBlocks(0),
+			preloadedAtBlock(0),
+			kernels(&simd::getKernels(simd::Path::Scalar)),
+			mtsMaster(),
+			isMaster(false),
+			wantsMaster(false),
+			isActive(false),
+			modTable(),
+			freqTable(modTable),
+			nextKeyTable(),
+			keyLog(),
+			nextKeyLog(),
+			keyDelta(),
+			modChannelTables(),
+			channelTables(modChannelTables),
+			numMultiChannels(0),
 			xen(0.),
 			anchorFreq(0.),
 			pbRange(0.),
+			xenDepth(0.),
+			anchorDepth(0.),
+			numSubTicksInv(1.),
+			numSubTicks(1),
+			subTick(0),
+			samplesLeft(0),
+			mtsInterval(1),
+			mtsSamplesLeft(0),
+			sweepSamples(0),
+			samplesSinceRetune(0),
 			stepsIn12(false),
 			mtsEnabled(false),
+			sysexEnabled(false),
+			multiChannel(false),
+			sharePending(false),
+			scale(nullptr),
+			modulator(),
 			synth(mpeSplit),
 			rescaler(mpeSplit),
-			name("")
+			mtsPublisher(),
+			tuningBus(),
+			sysexOut(),
+			thru(),
+			name(),
+			statistics(_statistics)
 		{
-			if (MTS_CanRegisterMaster())
-				MTS_RegisterMaster();
-			startTimerHz(1);
+			tuningCache->addInstance();
+			channelTableCache->addInstance();
 		}
 
 		~Xen()
 		{
-			MTS_DeregisterMaster();
+			mtsMaster->deactivate(this);
+			tuningCache->removeInstance();
+			channelTableCache->removeInstance();
 		}
 
-		void timerCallback() override
+		// the next publish sends everything, which also takes over the tuning bus
+		void masterChanged(bool _isMaster) noexcept override
 		{
-			if (MTS_CanRegisterMaster())
-				MTS_RegisterMaster();
+			isMaster.store(_isMaster);
+			if (_isMaster)
+				mtsPublisher.invalidate();
+			else
+				tuningBus.release();
+		}
+
+		struct Parameters
+		{
+			double xen, anchorFreq, pbRange;
+			Mode mode;
+			bool stepsIn12, multiChannel;
+			const scala::Scale* scale;
+		};
+
+		void updateParameters(const Parameters& p) noexcept
+		{
+			updateParameters(p.xen, p.anchorFreq, p.pbRange, p.mode,
+				p.stepsIn12, p.multiChannel, p.scale);
 		}
 
 		void updateParameters(double _xen, double _anchorFreq,
-			double _pbRange, bool _mtsEnabled, bool _stepsIn12) noexcept
+			double _pbRange, Mode _mode, bool _stepsIn12,
+			bool _multiChannel, const scala::Scale* _scale) noexcept
 		{
-			if (_mtsEnabled)
+			const auto _sysexEnabled = _mode == Mode::SysEx;
+			if (sysexEnabled != _sysexEnabled)
+			{
+				sysexEnabled = _sysexEnabled;
+				if (sysexEnabled)
+					sysexOut.invalidate();
+				else
+					resetSysex();
+				forceUpdate();
+			}
+
+			if (_mode == Mode::MTSESP)
 			{
 				if (!mtsEnabled)
 				{
 					mtsEnabled = true;
 					forceUpdate();
+					wantsMaster.store(true);
 				}
 				if (xen != _xen ||
 					anchorFreq != _anchorFreq ||
-					stepsIn12 != _stepsIn12)
+					stepsIn12 != _stepsIn12 ||
+					multiChannel != _multiChannel ||
+					scale != _scale)
 				{
 					xen = _xen;
 					anchorFreq = _anchorFreq;
 					stepsIn12 = _stepsIn12;
-					updateFreqTable();
-					updateMTS();
+					multiChannel = _multiChannel;
+					scale = _scale;
+					if (!modulator.isActive())
+					{
+						updateFreqTable();
+						updateMultiChannelTables(freqTable, xen, anchorFreq);
+						updateMTS(freqTable, xen);
+					}
 				}
 			}
 			else
@@ -74,20 +180,27 @@ namespace xen
 				if (mtsEnabled)
 				{
 					mtsEnabled = false;
+					// resets the clients to 12 tet while still master, then lets another instance take over
 					xen = 12.;
 					anchorFreq = 440.;
 					stepsIn12 = true;
+					scale = nullptr;
 					updateFreqTable();
-					updateMTS();
+					updateMultiChannelTables(freqTable, xen, anchorFreq);
+					updateMTS(freqTable, xen);
+					wantsMaster.store(false);
 				}
 				if (xen != _xen ||
 					anchorFreq != _anchorFreq ||
-					stepsIn12 != _stepsIn12)
+					stepsIn12 != _stepsIn12 ||
+					scale != _scale)
 				{
 					xen = _xen;
 					anchorFreq = _anchorFreq;
 					stepsIn12 = _stepsIn12;
-					updateFreqTable();
+					scale = _scale;
+					if (!modulator.isActive())
+						updateFreqTable();
 				}
 			}
 			
@@ -98,27 +211,285 @@ namespace xen
 			}
 		}
 
-		void prepare(double sampleRate) noexcept
+		// type, rateHz, xenDepth [steps], anchorDepth [semitones], ccNumber, steps
+		void updateModulation(mod::Type type, double rateHz, double _xenDepth,
+			double _anchorDepth, int ccNumber, const double* steps) noexcept
+		{
+			const auto wasActive = modulator.isActive();
+			modulator.setType(type);
+			modulator.setRate(rateHz);
+			modulator.setCC(ccNumber);
+			for (auto i = 0; i < mod::Modulator::NumSteps; ++i)
+				modulator.setStep(i, steps[i]);
+			xenDepth = _xenDepth;
+			anchorDepth = _anchorDepth;
+
+			const auto isActive = modulator.isActive();
+			if (wasActive == isActive)
+				return;
+			if (isActive)
+			{
+				juce::FloatVectorOperations::copy(nextKeyTable, freqTable, NumPitches);
+				toLog2(nextKeyLog, nextKeyTable);
+				sharePending = false;
+				subTick = 0;
+				samplesLeft = 0;
+				mtsSamplesLeft = 0;
+			}
+			else
+				forceUpdate();
+		}
+
+		void processModulationMidi(const Midi& midi) noexcept
+		{
+			modulator.processMidi(midi);
+		}
+
+		// the channel messages before auto mpe, which sysex mode forwards unchanged.
+		// copied in every mode, so the block that switches to sysex mode keeps its notes
+		void processThru(const Midi& midi)
 		{
-			synth.prepare(sampleRate);
+			thru.clear();
+			// the others stay in the block's midi through the split
+			for (const auto it : midi)
+				if (it.numBytes != 0 && it.data[0] >= 0x80 && it.data[0] < 0xf0)
+					thru.addEvent(it.data, it.numBytes, it.samplePosition);
+		}
+
+		void processSysex(const Midi& midi) noexcept
+		{
+			synth.processSysex(midi);
+		}
+
+		// only the synth degrades, the midi output stays the same
+		void setQuality(quality::Tier tier) noexcept
+		{
+			synth.setQuality(tier);
+		}
+
+		// everything that connects to other processes or allocates is set up here
+		// rather than in the constructor, which keeps plugin scans fast.
+		// the kernels for this cpu are picked here too. only instances in mts-esp mode
+		// compete for the master, the others (de)activate in updateMaster when the mode changes
+		void prepare(double sampleRate)
+		{
+			kernels = &simd::getKernels();
+			// before the synth registers its mts client, so it can fall back to the bus
+			tuningBus.open();
+			TuningBus::connectClients();
+			synth.prepare(sampleRate, *kernels);
+			rescaler.prepare(MidiBufferBytes * mpe::NumChannelsMPE);
+			thru.ensureSize(static_cast<size_t>(MidiBufferBytes * mpe::NumChannelsMPE));
+			const auto samplesPerKeyframe = sampleRate / ControlRateHz;
+			const auto numSubTicksD = std::round(samplesPerKeyframe / static_cast<double>(UpdateInterval));
+			numSubTicks = juce::jmax(1, static_cast<int>(numSubTicksD));
+			numSubTicksInv = 1. / static_cast<double>(numSubTicks);
+			modulator.prepare(sampleRate / static_cast<double>(numSubTicks * UpdateInterval));
+			mtsInterval = juce::jmax(1, static_cast<int>(sampleRate / MaxMTSRateHz));
+			sysexOut.prepare(sampleRate);
+			sweepSamples = static_cast<int>(sampleRate * SweepSeconds);
+			samplesSinceRetune = sweepSamples;
+			sharePending = false;
+			subTick = 0;
+			samplesLeft = 0;
+			mtsSamplesLeft = 0;
 			forceUpdate();
+			wantsMaster.store(mtsEnabled);
+			updateMaster();
+		}
+
+		// lets the next activated instance become master
+		void release()
+		{
+			wantsMaster.store(false);
+			updateMaster();
+		}
+
+		// not on the audio thread. the registry locks, calls libMTS and the other instances,
+		// so the audio thread only flags mode changes and they are (de)activated here
+		void updateMaster()
+		{
+			const auto wants = wantsMaster.load();
+			if (isActive == wants)
+				return;
+			isActive = wants;
+			if (isActive)
+				mtsMaster->activate(this);
+			else
+				mtsMaster->deactivate(this);
+		}
+
+		// not on the audio thread, checking the owner is a syscall. beats for the readers
+		// while this instance owns the tuning bus. if the owner is gone or removed the bus,
+		// the master takes it over with a full publish in the next block
+		void checkTuningBus() noexcept
+		{
+			tuningBus.beat();
+			if (isMaster.load() && tuningBus.isAvailable())
+				mtsPublisher.invalidate();
+			TuningBus::checkClients();
 		}
 
 		void operator()(float* const* samples, Midi& midi, int numSamples)
 		{
-			if (mtsEnabled)
-				return synth.synthMTS(samples, numSamples);
-			synth.synthMPE(samples, freqTable, numSamples);
-			rescaler(midi, freqTable, numSamples);
+			XEN_TRACE_SCOPE("xen");
+			beginBlock();
+			process(samples, 0, numSamples);
+			endBlock(midi, numSamples);
+		}
+
+		// for splitting a block at parameter changes:
+		// beginBlock, process each sub block, endBlock
+		void beginBlock() noexcept
+		{
+			rescaler.begin();
+			sysexOut.begin();
+			if (modulator.isActive())
+				return;
+			if (sharePending && samplesSinceRetune >= sweepSamples)
+				shareFreqTable();
+			// e.g. after becoming master. checked here because
+			// updateParameters only runs when parameters change
+			if (mtsEnabled && !mtsPublisher.isValid())
+			{
+				updateMultiChannelTables(freqTable, xen, anchorFreq);
+				updateMTS(freqTable, xen);
+			}
+		}
+
+		// samples, start, end
+		void process(float* const* samples, int start, int end)
+		{
+			if (modulator.isActive())
+				return processModulated(samples, start, end);
+			render(samples, start, end);
+		}
+
+		void endBlock(Midi& midi, int numSamples)
+		{
+			XEN_TRACE_SCOPE("end block");
+			// retunings go out before the notes that depend on them
+			sysexOut.end(midi, numSamples);
+			rescaler.end(midi, numSamples);
+			samplesSinceRetune = juce::jmin(samplesSinceRetune + numSamples, sweepSamples);
+			numBlocks.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		simd::Path getKernelPath() const noexcept
+		{
+			return kernels->path;
+		}
+
+		// shared by all instances: memory and table computations saved by sharing
+		TuningCache::Stats getTuningCacheStats() const noexcept
+		{
+			return tuningCache->getStats();
+		}
+
+		ChannelTableCache::Stats getChannelTableCacheStats() const noexcept
+		{
+			return channelTableCache->getStats();
+		}
+
+		// parameters, table
+		// caches a table restored from a session, so the first block doesn't compute it.
+		// the table is held until a block was processed since
+		void preloadTable(const Parameters& p, const double* table)
+		{
+			const auto key = makeTuningKey(p.xen, p.anchorFreq, p.stepsIn12, p.scale);
+			preloaded = tuningCache->acquire(key, [table](double* dest)
+			{
+				std::copy(table, table + NumPitches, dest);
+			});
+			preloadedAtBlock = numBlocks.load();
+		}
+
+		// not on the audio thread, like preloadTable
+		void releasePreloadedTable() noexcept
+		{
+			if (preloaded.data() != nullptr && numBlocks.load() != preloadedAtBlock)
+				preloaded.reset();
+		}
+
+		// parameters, table
+		// false if the tuning of these parameters isn't cached
+		bool copyTable(const Parameters& p, double* table) const noexcept
+		{
+			const auto key = makeTuningKey(p.xen, p.anchorFreq, p.stepsIn12, p.scale);
+			return tuningCache->copy(key, table);
+		}
+
+		// table, xen, anchorFreq, stepsIn12, scale (nullptr for none), kernels
+		// the table of these parameters, also for tools that retune without a processor
+		static void fillFreqTable(double* table, double xenV, double anchorFreqV,
+			bool stepsIn12V, const scala::Scale* scaleV, const simd::Kernels& kernelsV) noexcept
+		{
+			if (scaleV != nullptr)
+				return fillFreqTableFromScale(table, anchorFreqV, 0, *scaleV, kernelsV);
+			if (stepsIn12V)
+			{
+				for (int i = 0; i < NumPitches; ++i)
+					table[i] = math::noteToFreqIn12Steps(static_cast<double>(i), xenV, 69., anchorFreqV);
+				return;
+			}
+			double exponents[NumPitches];
+			for (int i = 0; i < NumPitches; ++i)
+				exponents[i] = (static_cast<double>(i) - 69.) / xenV;
+			kernelsV.exp2(table, exponents, anchorFreqV, NumPitches);
+		}
+
+		MTSMaster::State getMasterState() const
+		{
+			return mtsMaster->getState();
+		}
+
+		// only after the user confirmed that the blocking master is left over from a crash
+		bool reinitializeMaster()
+		{
+			return mtsMaster->reinitialize();
 		}
 	private:
-		double freqTable[NumPitches];
-		double xen, anchorFreq, pbRange;
-		bool stepsIn12, mtsEnabled;
+		juce::SharedResourcePointer<TuningCache> tuningCache;
+		juce::SharedResourcePointer<ChannelTableCache> channelTableCache;
+		TuningCache::Handle tuning;
+		ChannelTableCache::Handle channels;
+		// a table restored from a session, held until the first block acquired it
+		TuningCache::Handle preloaded;
+		std::atomic<uint64_t> numBlocks;
+		uint64_t preloadedAtBlock;
+		const simd::Kernels* kernels;
+		juce::SharedResourcePointer<MTSMaster> mtsMaster;
+		// only the master publishes, the other instances follow it as clients
+		std::atomic<bool> isMaster;
+		// set by the audio thread in mts-esp mode, isActive follows it on the message thread
+		std::atomic<bool> wantsMaster;
+		bool isActive;
+		// interpolated table while modulating, or the fallback if the cache is full
+		double modTable[NumPitches];
+		// the table in use, usually shared with other instances
+		const double* freqTable;
+		// keyframes are interpolated in log2 frequency, so glides are even in pitch
+		double nextKeyTable[NumPitches], keyLog[NumPitches], nextKeyLog[NumPitches], keyDelta[NumPitches];
+		// multi-channel tables while modulating or sweeping, or the fallback if the cache is full
+		double modChannelTables[NumChannels][NumPitches];
+		const double (*channelTables)[NumPitches];
+		int numMultiChannels;
+		double xen, anchorFreq, pbRange, xenDepth, anchorDepth, numSubTicksInv;
+		int numSubTicks, subTick, samplesLeft, mtsInterval, mtsSamplesLeft, sweepSamples, samplesSinceRetune;
+		// the table of a sweep goes into the cache once it holds still
+		bool stepsIn12, mtsEnabled, sysexEnabled, multiChannel, sharePending;
+		const scala::Scale* scale;
+		mod::Modulator modulator;
 
 		syn::Synth synth;
 		XenRescalerMPE rescaler;
-		String name;
+		MTSPublisher mtsPublisher;
+		TuningBus::Writer tuningBus;
+		MTSSysex sysexOut;
+		Midi thru;
+		// the name of an edo, formatted without allocating
+		char name[MTSPublisher::NameSize];
+		stats::Registry& statistics;
 
 		void forceUpdate() noexcept
 		{
@@ -127,43 +498,294 @@ namespace xen
 
 		void updateFreqTable() noexcept
 		{
-			const auto hzFunc = stepsIn12 ?
-				[](double pitch, double xen, double anchorFreq)
-				{
-					return math::noteToFreqIn12Steps(pitch, xen, 69., anchorFreq);
-				} :
-				[](double pitch, double xen, double anchorFreq)
+			XEN_TRACE_SCOPE("tuning");
+			// while xen is swept each table is new, and would only push other tunings out of the cache
+			sharePending = samplesSinceRetune < sweepSamples;
+			samplesSinceRetune = 0;
+			if (sharePending)
+				tuning.reset();
+			else
+			{
+				const auto key = makeTuningKey(xen, anchorFreq, stepsIn12, scale);
+				tuning = tuningCache->acquire(key, [this](double* table)
 				{
-					return math::noteToFreq(pitch, xen, 69., anchorFreq);
-				};
-				for (int i = 0; i < NumPitches; ++i)
+					statistics.add(stats::Counter::TuningRecomputes);
+					fillFreqTable(table, xen, anchorFreq);
+				});
+			}
+			freqTable = tuning.data();
+			if (freqTable == nullptr)
+			{
+				statistics.add(stats::Counter::TuningRecomputes);
+				fillFreqTable(modTable, xen, anchorFreq);
+				freqTable = modTable;
+			}
+			synth.update(freqTable);
+			if (sysexEnabled)
+				updateSysex(freqTable, xen);
+		}
+
+		// after a sweep, the table it stopped at is shared. a hit if another instance has it
+		void shareFreqTable() noexcept
+		{
+			sharePending = false;
+			const auto key = makeTuningKey(xen, anchorFreq, stepsIn12, scale);
+			tuning = tuningCache->acquire(key, [this](double* table)
+			{
+				std::copy(modTable, modTable + NumPitches, table);
+			});
+			if (tuning.data() == nullptr)
+				return;
+			freqTable = tuning.data();
+			synth.update(freqTable);
+			if (mtsEnabled)
+				updateMultiChannelTables(freqTable, xen, anchorFreq);
+		}
+
+		// table, xen, anchorFreq
+		void fillFreqTable(double* table, double xenV, double anchorFreqV) const noexcept
+		{
+			fillFreqTable(table, xenV, anchorFreqV, stepsIn12, scale, *kernels);
+		}
+
+		// table, anchorFreq, offset [notes]
+		void fillFreqTableFromScale(double* table, double anchorFreqV, int offset) const noexcept
+		{
+			fillFreqTableFromScale(table, anchorFreqV, offset, *scale, *kernels);
+		}
+
+		void processModulated(float* const* samples, int start, int end)
+		{
+			auto s = start;
+			while (s < end)
+			{
+				if (samplesLeft == 0)
 				{
-					const auto iD = static_cast<double>(i);
-					const auto hz = hzFunc(iD, xen, anchorFreq);
-					freqTable[i] = hz;
+					// held mpe notes follow the keyframes with pitch bends
+					if (tick() && !mtsEnabled && !sysexEnabled)
+						rescaler.retune(freqTable, s);
+					samplesLeft = UpdateInterval;
 				}
-				synth.update(&freqTable[0]);
+				const auto e = juce::jmin(end, s + samplesLeft);
+				render(samples, s, e);
+				samplesLeft -= e - s;
+				s = e;
+			}
 		}
 
-		void updateMTS()
+		// renders [start, end[ with the current freqTable
+		void render(float* const* samples, int start, int end)
 		{
-			MTS_SetNoteTunings(freqTable);
-			//step size in cents = 1200. * std::log2(2) / xen;
-			MTS_SetPeriodRatio(2.);
-			if(stepsIn12)
+			// retunings go out first, also the reset to 12 tet after leaving sysex mode
+			sysexOut.emit(start);
+			sysexOut.advance(end - start);
+			{
+				XEN_TRACE_SCOPE("synth");
+				if (mtsEnabled)
+					return synth.synthMTS(samples, start, end);
+				synth.synthMPE(samples, freqTable, start, end);
+			}
+			XEN_TRACE_SCOPE("rescale");
+			if (!sysexEnabled)
+				return rescaler.process(freqTable, start, end);
+			rescaler.passThrough(thru, start, end);
+		}
+
+		// interpolates between the last 2 keyframes
+		// true if this tick started a keyframe
+		bool tick() noexcept
+		{
+			const auto isKeyframe = subTick == 0;
+			if (isKeyframe)
+				keyframe();
+			const auto frac = static_cast<double>(subTick) * numSubTicksInv;
+			double exponents[NumPitches];
+			juce::FloatVectorOperations::copy(exponents, keyLog, NumPitches);
+			juce::FloatVectorOperations::addWithMultiply(exponents, keyDelta, frac, NumPitches);
+			kernels->exp2(modTable, exponents, 1., NumPitches);
+			freqTable = modTable;
+			synth.update(freqTable);
+			subTick = subTick + 1 == numSubTicks ? 0 : subTick + 1;
+			return isKeyframe;
+		}
+
+		void keyframe() noexcept
+		{
+			XEN_TRACE_SCOPE("keyframe");
+			const auto modValue = modulator();
+			const auto xenMin = static_cast<double>(axiom::MinXen);
+			const auto xenMax = static_cast<double>(axiom::MaxXen);
+			const auto xenMod = juce::jlimit(xenMin, xenMax, xen + xenDepth * modValue);
+			const auto anchorFreqMod = anchorFreq * std::exp2(anchorDepth * modValue / 12.);
+
+			juce::FloatVectorOperations::copy(keyLog, nextKeyLog, NumPitches);
+			statistics.add(stats::Counter::TuningRecomputes);
+			fillFreqTable(nextKeyTable, xenMod, anchorFreqMod);
+			toLog2(nextKeyLog, nextKeyTable);
+			juce::FloatVectorOperations::subtract(keyDelta, nextKeyLog, keyLog, NumPitches);
+
+			if (!mtsEnabled && !sysexEnabled)
+				return;
+			mtsSamplesLeft -= numSubTicks * UpdateInterval;
+			const auto isValid = sysexEnabled ? sysexOut.isValid() : mtsPublisher.isValid();
+			if (mtsSamplesLeft > 0 && isValid)
+				return;
+			mtsSamplesLeft = mtsInterval;
+			if (sysexEnabled)
+				return updateSysex(nextKeyTable, xenMod);
+			updateMultiChannelTables(nextKeyTable, xenMod, anchorFreqMod);
+			updateMTS(nextKeyTable, xenMod);
+		}
+
+		// spreads the scale over several midi channels of 128 keys each, so that
+		// large edos get their full range. the middle channel holds the regular table.
+		// only the master publishes them, so the other instances don't compute them.
+		// table, xen, anchorFreq
+		void updateMultiChannelTables(const double* table, double xenV, double anchorFreqV) noexcept
+		{
+			const auto canUseMultiChannel = mtsEnabled && multiChannel && !stepsIn12 &&
+				(scale == nullptr || !scale->absolute) && isMaster.load();
+			if (!canUseMultiChannel)
 			{
-				MTS_SetMapSize(12);
+				numMultiChannels = 0;
+				channels.reset();
+				return;
+			}
+			const auto stepsPerOctave = scale == nullptr ? xenV :
+				static_cast<double>(scale->size()) * 1200. / scale->period();
+			const auto numKeys = std::ceil(MultiChannelOctaves * stepsPerOctave);
+			const auto numChannelsD = std::ceil(numKeys / static_cast<double>(NumPitches));
+			numMultiChannels = juce::jlimit(1, NumChannels, static_cast<int>(numChannelsD));
+			// a cached table's channels are cached with the same key, keyframes and sweeps stay local
+			if (table == tuning.data())
+			{
+				const auto key = makeTuningKey(xenV, anchorFreqV, false, scale);
+				channels = channelTableCache->acquire(key, [this, table, xenV, anchorFreqV](double* dest)
+				{
+					fillMultiChannelTables(reinterpret_cast<double(*)[NumPitches]>(dest), table, xenV, anchorFreqV);
+				});
+				if (channels.data() != nullptr)
+				{
+					channelTables = channels.tables();
+					return;
+				}
 			}
 			else
+				channels.reset();
+			fillMultiChannelTables(modChannelTables, table, xenV, anchorFreqV);
+			channelTables = modChannelTables;
+		}
+
+		// dest, table, xen, anchorFreq
+		void fillMultiChannelTables(double (*dest)[NumPitches], const double* table,
+			double xenV, double anchorFreqV) const noexcept
+		{
+			const auto anchorChannel = numMultiChannels / 2;
+			for (auto ch = 0; ch < numMultiChannels; ++ch)
+			{
+				const auto offset = (ch - anchorChannel) * NumPitches;
+				auto channelTable = dest[ch];
+				if (scale != nullptr)
+					fillFreqTableFromScale(channelTable, anchorFreqV, offset);
+				else
+				{
+					const auto ratio = std::exp2(static_cast<double>(offset) / xenV);
+					juce::FloatVectorOperations::multiply(channelTable, table, ratio, NumPitches);
+				}
+			}
+		}
+
+		// table, xen
+		void updateMTS(const double* table, double xenV)
+		{
+			if (!isMaster.load())
+				return;
+			XEN_TRACE_SCOPE("mts publish");
+			if (scale != nullptr)
 			{
-				const auto xenRound = std::round(xen);
-				const auto xenChar = static_cast<char>(xenRound);
-				MTS_SetMapSize(xenChar);
+				const auto periodRatio = std::exp2(scale->period() / 1200.);
+				const auto mapSize = toMapSize(scale->size());
+				return publish(table, periodRatio, mapSize, 69, 69, scale->name.toRawUTF8());
 			}
-			MTS_SetRefKey(69);
-			MTS_SetMapStartKey(69 - 1);
-			name = String(xen, 2) + " tet";
-			MTS_SetScaleName(name.getCharPointer());
+			//step size in cents = 1200. * std::log2(2) / xen;
+			const auto xenRound = static_cast<int>(std::round(xenV));
+			const auto mapSize = stepsIn12 ? static_cast<char>(12) : toMapSize(xenRound);
+			makeTetName(xenV);
+			publish(table, 2., mapSize, 69, 69 - 1, name);
+		}
+
+		// table, periodRatio, mapSize, refKey, mapStartKey, name
+		void publish(const double* table, double periodRatio, char mapSize,
+			char refKey, char mapStartKey, const char* tuningName)
+		{
+			const auto numUnchanged = mtsPublisher(table, channelTables, numMultiChannels,
+				periodRatio, mapSize, refKey, mapStartKey, tuningName);
+			statistics.add(stats::Counter::MTSPublishes);
+			statistics.add(stats::Counter::NotesUnchanged, static_cast<uint64_t>(numUnchanged));
+			tuningBus.publish(table, channelTables, numMultiChannels,
+				periodRatio, mapSize, refKey, mapStartKey, tuningName);
+		}
+
+		// table, xen
+		void updateSysex(const double* table, double xenV)
+		{
+			XEN_TRACE_SCOPE("sysex compile");
+			statistics.add(stats::Counter::SysexRetunes);
+			if (scale != nullptr)
+				return sysexOut.compile(table, scale->name.toRawUTF8());
+			makeTetName(xenV);
+			sysexOut.compile(table, name);
+		}
+
+		// xen
+		// like String(xenV, 2) + " tet", but without allocating or depending on the locale
+		void makeTetName(double xenV) noexcept
+		{
+			const auto hundredths = std::llround(xenV * 100.);
+			std::snprintf(name, sizeof(name), "%lld.%02lld tet", hundredths / 100, hundredths % 100);
+		}
+
+		// leaves the receiver in 12 tet, like the mts-esp clients when the master leaves.
+		// compiled against the last emitted tuning, so it's usually a few single note changes
+		void resetSysex()
+		{
+			double table[NumPitches];
+			for (auto i = 0; i < NumPitches; ++i)
+				table[i] = math::noteToFreq(static_cast<double>(i));
+			sysexOut.compile(table, "12 tet");
+		}
+
+		// table, anchorFreq, offset [notes], scale, kernels
+		static void fillFreqTableFromScale(double* table, double anchorFreqV, int offset,
+			const scala::Scale& scaleV, const simd::Kernels& kernelsV) noexcept
+		{
+			// clamped to the kernel's range, far beyond what can be heard
+			double exponents[NumPitches];
+			for (int i = 0; i < NumPitches; ++i)
+				exponents[i] = juce::jlimit(-1022., 1023., scaleV.noteToCents(i + offset, 69) / 1200.);
+			kernelsV.exp2(table, exponents, anchorFreqV, NumPitches);
+		}
+
+		// xen, anchorFreq, stepsIn12, scale
+		static TuningCache::Key makeTuningKey(double xenV, double anchorFreqV,
+			bool stepsIn12V, const scala::Scale* scaleV) noexcept
+		{
+			if (scaleV != nullptr)
+				return { 0., anchorFreqV, scaleV, false };
+			return { xenV, anchorFreqV, nullptr, stepsIn12V };
+		}
+
+		// dest, table
+		static void toLog2(double* dest, const double* table) noexcept
+		{
+			for (auto i = 0; i < NumPitches; ++i)
+				dest[i] = std::log2(table[i]);
+		}
+
+		// map sizes beyond a char are reported as unknown
+		static char toMapSize(int size) noexcept
+		{
+			return size > 127 ? static_cast<char>(-1) : static_cast<char>(size);
 		}
 	};
 }
\ No newline at end of file
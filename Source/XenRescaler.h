@@ -16,7 +16,9 @@ namespace xen
 	public:
 		XenRescaler() :
 			curNote(MidiMessage::noteOn(1, 0, Unit8(0))),
-			pbRange(0.)
+			pbRange(0.),
+			heldPitch(-1),
+			pitchbend(0)
 		{
 		}
 
@@ -25,13 +27,16 @@ namespace xen
 			pbRange = _pbRange;
 		}
 
-		void operator()(MidiBuffer& midi, MidiBuffer& buffer,
-			const double* freqTable)
+		// midi, buffer, freqTable, start, end
+		void operator()(const MidiBuffer& midi, MidiBuffer& buffer,
+			const double* freqTable, int start, int end)
 		{
-			for (const auto it : midi)
+			for (auto it = midi.findNextSamplePosition(start); it != midi.cend(); ++it)
 			{
-				const auto ts = it.samplePosition;
-				const auto msg = it.getMessage();
+				const auto ts = (*it).samplePosition;
+				if (ts >= end)
+					break;
+				const auto msg = (*it).getMessage();
 				if (msg.isNoteOn())
 				{
 					const auto channel = msg.getChannel();
@@ -39,17 +44,37 @@ namespace xen
 					const auto pitch = msg.getNoteNumber();
 					const auto freq = freqTable[pitch];
 					processNoteOn(buffer, velo, freq, pbRange, channel, ts);
+					heldPitch = pitch;
 				}
 				else if (msg.isNoteOff())
+				{
 					processNoteOff(buffer, ts);
+					heldPitch = -1;
+				}
 				else
 					buffer.addEvent(msg, ts);
 			}
 		}
 	
+		// buffer, freqTable, ts
+		// bends the held note to its frequency in freqTable, if that moved
+		void retune(MidiBuffer& buffer, const double* freqTable, int ts)
+		{
+			if (heldPitch < 0)
+				return;
+			const auto note = math::freqToNote(freqTable[heldPitch]);
+			const auto bend = toPitchbend(note - static_cast<double>(curNote.getNoteNumber()), pbRange);
+			if (bend == pitchbend)
+				return;
+			pitchbend = bend;
+			buffer.addEvent(MidiMessage::pitchWheel(curNote.getChannel(), pitchbend), ts);
+		}
+	
 	private:
 		MidiMessage curNote;
 		double pbRange;
+		// the input note sounding on this channel (-1 if none), the last bend sent for it
+		int heldPitch, pitchbend;
 
 		void processNoteOn(MidiBuffer& buffer, float velocity,
 			double freq, double pitchbendRange, int channel, int ts)
@@ -61,10 +86,9 @@ namespace xen
 			const auto noteRound = std::round(note);
 			curNote.setNoteNumber(static_cast<int>(noteRound));
 
-			const auto noteFrac = (note - noteRound) / pitchbendRange;
-			const auto pitchbend = noteFrac * PBRangeHalf + PBRangeHalf;
+			pitchbend = toPitchbend(note - noteRound, pitchbendRange);
 
-			buffer.addEvent(MidiMessage::pitchWheel(channel, static_cast<int>(pitchbend)), ts);
+			buffer.addEvent(MidiMessage::pitchWheel(channel, pitchbend), ts);
 			buffer.addEvent(curNote, ts);
 		}
 
@@ -74,6 +98,14 @@ namespace xen
 			const auto note = curNote.getNoteNumber();
 			buffer.addEvent(MidiMessage::noteOff(channel, note), ts);
 		}
+
+		// semitones off the note, pitchbendRange
+		// beyond the range, e.g. after a long glide, the bend stays at its end
+		static int toPitchbend(double noteOffset, double pitchbendRange) noexcept
+		{
+			const auto pb = noteOffset / pitchbendRange * PBRangeHalf + PBRangeHalf;
+			return static_cast<int>(juce::jlimit(0., PBRange, pb));
+		}
 	};
 
 	struct XenRescalerMPE
@@ -87,6 +119,11 @@ namespace xen
 		{
 		}
 
+		void prepare(int numBytes)
+		{
+			buffer.ensureSize(static_cast<size_t>(numBytes));
+		}
+
 		void update(double pbRange) noexcept
 		{
 			for (auto& voice : xenRescaler)
@@ -95,14 +132,45 @@ namespace xen
 
 		void operator()(MidiBuffer& midiMessages,
 			const double* freqTable, int numSamples)
+		{
+			begin();
+			process(freqTable, 0, numSamples);
+			end(midiMessages, numSamples);
+		}
+
+		void begin() noexcept
 		{
 			buffer.clear();
+		}
+
+		// freqTable, start, end
+		void process(const double* freqTable, int start, int end)
+		{
 			for (auto ch = 0; ch < mpe::NumChannelsMPE; ++ch)
 			{
 				auto& rescaler = xenRescaler[ch];
-				auto& midi = mpe[ch + 2];
-				rescaler(midi, buffer, freqTable);
+				const auto& midi = mpe[ch + 2];
+				rescaler(midi, buffer, freqTable, start, end);
 			}
+		}
+
+		// freqTable, ts
+		// pitch bends for the held notes whose frequency changed, e.g. at a modulation keyframe
+		void retune(const double* freqTable, int ts)
+		{
+			for (auto& voice : xenRescaler)
+				voice.retune(buffer, freqTable, ts);
+		}
+
+		// midi, start, end
+		// forwards the midi as it came in, for when the receiver gets retuned instead
+		void passThrough(const MidiBuffer& midi, int start, int end)
+		{
+			buffer.addEvents(midi, start, end - start, 0);
+		}
+
+		void end(MidiBuffer& midiMessages, int numSamples)
+		{
 			midiMessages.addEvents(buffer, 0, numSamples, 0);
 		}
 
@@ -9,6 +9,9 @@ THIS SOFTWARE.
 
 #include "libMTSClient.h"
 #include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__) || defined(__TOS_WIN__) || defined(_MSC_VER)
 #define MTS_ESP_WIN
 #define WIN32_LEAN_AND_MEAN
@@ -56,7 +59,10 @@ struct mtsclientglobal
     , handle(0)
     {
         for (int i = 0; i < 128; i++)
-            iet[i] = 1. / (440.0 * pow(2.0, (i - 69.0) / 12.0));
+        {
+            et[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
+            iet[i] = 1. / et[i];
+        }
         
         load_lib();
         
@@ -86,6 +92,7 @@ struct mtsclientglobal
     mts_char__void GetRefKey;
     
     // tuning tables
+    double et[128];
     double iet[128];
     const double *esp_retuning;
     const double *multi_channel_esp_retuning[16];
@@ -193,7 +200,117 @@ struct mtsclientglobal
 #endif
 };
 
-static mtsclientglobal global;
+// Constructed by the first use, usually the first client registering, so that merely loading the module doesn't load libMTS.
+static mtsclientglobal &global() {static mtsclientglobal g; return g;}
+
+// Set by MTS_SetClientFallback(), each client reads it once when it registers.
+static std::atomic<const MTSClientFallback *> clientFallback(0);
+
+// 2^(detune / 12) for |detune| <= 1 semitone, as a degree 5 Taylor polynomial of exp(detune * ln2 / 12). Relative error is below 1e-10.
+static inline double detuneToRatio(double detune)
+{
+    const double x = detune * (ln2 / 12.0);
+    return 1.0 + x * (1.0 + x * (0.5 + x * (1.0 / 6.0 + x * (1.0 / 24.0 + x * (1.0 / 120.0)))));
+}
+
+// Sorted index of the unfiltered notes of up to MaxTables tuning tables, for nearest-note lookups by binary search.
+// It is built for one tuning version (see MTSClient::tuningVersion) and stays valid until the version changes.
+// The index is a seqlock: lookups never wait or write. While another thread builds it, they return eStale and the caller scans the tables itself.
+template <int MaxTables>
+struct MTSNoteIndex
+{
+    enum {eMaxEntries = MaxTables * 128, eStale = -2};
+    
+    MTSNoteIndex() : sequence(0), version(0), numEntries(0), numTables(0) {}
+    
+    // tables, table channels, number of tables, version, filter(note, channel)
+    // returns false without building if another thread is building it
+    template <typename Filter>
+    bool build(const double *const *tables, const int *_channels, int _numTables, unsigned int _version, const Filter &shouldFilter)
+    {
+        unsigned int seq = sequence.load(std::memory_order_relaxed);
+        if ((seq & 1) || !sequence.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed))
+            return false;
+        std::atomic_thread_fence(std::memory_order_release);
+        
+        int n = 0;
+        for (int t = 0; t < _numTables; t++)
+        {
+            channels[t] = _channels[t];
+            for (int note = 0; note < 128; note++)
+                if (!shouldFilter(note, _channels[t]))
+                    entries[n++] = (t << 7) | note;
+        }
+        
+        // equal frequencies resolve to the first entry, as in a linear scan
+        const auto freq = [tables](int entry) {return tables[entry >> 7][entry & 127];};
+        std::stable_sort(entries, entries + n, [&freq](int a, int b) {return freq(a) < freq(b);});
+        int unique = 0;
+        for (int i = 0; i < n; i++)
+            if (!unique || freq(entries[i]) != freq(entries[unique - 1]))
+                entries[unique++] = entries[i];
+        
+        // geometric midpoints between neighbours
+        for (int i = 0; i < unique - 1; i++)
+            mids[i] = sqrt(freq(entries[i]) * freq(entries[i + 1]));
+        
+        numEntries.store(unique, std::memory_order_relaxed);
+        numTables.store(_numTables, std::memory_order_relaxed);
+        version.store(_version, std::memory_order_relaxed);
+        sequence.store(seq + 2, std::memory_order_release);
+        return true;
+    }
+    
+    // the entry (table << 7 | note) nearest to freq, -1 if every note is filtered,
+    // eStale if the index isn't built for this version or is being built
+    int nearest(double f, unsigned int _version) const
+    {
+        const unsigned int seq = sequence.load(std::memory_order_acquire);
+        if ((seq & 1) || version.load(std::memory_order_relaxed) != _version)
+            return eStale;
+        const int n = std::min(std::max(numEntries.load(std::memory_order_relaxed), 0), static_cast<int>(eMaxEntries));
+        const int entry = n ? entries[std::upper_bound(mids, mids + n - 1, f) - mids] : -1;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence.load(std::memory_order_relaxed) == seq ? entry : eStale;
+    }
+    
+    // the midi channel of the table of an entry returned by nearest() for the same version
+    int channel(int entry) const {return channels[(entry >> 7) % MaxTables];}
+    
+    // odd while building
+    std::atomic<unsigned int> sequence;
+    std::atomic<unsigned int> version;
+    std::atomic<int> numEntries;
+    std::atomic<int> numTables;
+    double mids[eMaxEntries];
+    int entries[eMaxEntries];
+    int channels[MaxTables];
+};
+
+// tables, table channels, number of tables, frequency, filter(note, channel)
+// The entry (table << 7 | note) nearest to freq by a linear scan, as the index would find it, or -1 if every note is filtered.
+template <typename Filter>
+static int nearestNoteLinear(const double *const *tables, const int *channels, int numTables, double f, const Filter &shouldFilter)
+{
+    int best = -1;
+    double bestDistance = 0.0;
+    double bestFreq = 0.0;
+    for (int t = 0; t < numTables; t++)
+    {
+        for (int note = 0; note < 128; note++)
+        {
+            const double x = tables[t][note];
+            const double distance = x > f ? x / f : f / x;
+            if ((best < 0 || distance < bestDistance || (distance == bestDistance && x > bestFreq)) && !shouldFilter(note, channels[t]))
+            {
+                best = (t << 7) | note;
+                bestDistance = distance;
+                bestFreq = x;
+            }
+        }
+    }
+    return best;
+}
 
 struct MTSClient
 {
@@ -217,6 +334,21 @@ struct MTSClient
     , supportsMultiChannelTuning(false)
     , freqRequestReceived(false)
     , receivedMTSSysEx(false)
+    , version(1)
+    , versionOnline(false)
+    , versionChannels(0)
+    , localTuningChanged(false)
+    , polledVersion(0)
+    , sysexState(eIgnoring)
+    , sysexFormat(eBulk)
+    , sysexCtr(0)
+    , sysexValue(0)
+    , sysexNote(0)
+    , sysexNumTunings(0)
+    , noteIndexesUsed(0)
+    , fallback(global().GetTuning ? 0 : clientFallback.load())
+    , fallbackVersion(0)
+    , esp_retuning(fallback ? fallbackTuning.table : global().esp_retuning)
     {
         for (int i = 0; i < 128; i++)
         {
@@ -233,21 +365,48 @@ struct MTSClient
             {
                 globalMultichannelTunings[i][j].flags = 0;
                 globalMultichannelTunings[i][j].freq = localFreqs[i];
+                versionMultiChannelFreqs[i][j] = 0.0;
             }
         }
+        memcpy(versionFreqs, localFreqs, sizeof(versionFreqs));
+        memset(versionFilters, 0, sizeof(versionFilters));
+        memset(versionMultiChannelFilters, 0, sizeof(versionMultiChannelFilters));
+        tuningName[16] = '\0';
+        
+        memset(&fallbackTuning, 0, sizeof(fallbackTuning));
+        for (int i = 0; i < 16; i++)
+            multi_channel_esp_retuning[i] = fallback ? fallbackTuning.channelTables[i] : global().multi_channel_esp_retuning[i];
                 
-        if (global.RegisterClient)
-            global.RegisterClient();
+        if (global().RegisterClient)
+            global().RegisterClient();
     }
     
     ~MTSClient()
     {
-        if (global.DeregisterClient)
-            global.DeregisterClient();
+        if (global().DeregisterClient)
+            global().DeregisterClient();
     }
     
-    inline bool hasMaster() {return global.isOnline();}
-    inline bool shouldUpdateLibrary() {return global.GetVersionNumber ? (global.GetVersionNumber() < libMTSVersion) : false;}
+    // with a fallback, the client reads from its own copy, which is refreshed here when the fallback's version changed
+    inline bool isOnline()
+    {
+        if (!fallback)
+            return global().isOnline();
+        const unsigned long long v = fallback->version();
+        if (v && v != fallbackVersion && fallback->read(&fallbackTuning))
+            fallbackVersion = v;
+        return v && fallbackVersion;
+    }
+    
+    inline bool useMultiChannelTuning(char midichannel)
+    {
+        if (fallback)
+            return !(midichannel & ~15) && ((fallbackTuning.channelsUsed >> midichannel) & 1);
+        return global().UseMultiChannelTuning && global().UseMultiChannelTuning(midichannel);
+    }
+    
+    inline bool hasMaster() {return isOnline();}
+    inline bool shouldUpdateLibrary() {return global().GetVersionNumber ? (global().GetVersionNumber() < libMTSVersion) : false;}
     
     inline double freq(char midinote, char midichannel)
     {
@@ -257,23 +416,125 @@ struct MTSClient
         freqRequestReceived = true;
         supportsMultiChannelTuning = !(midichannel & ~15);
         
-        if (!global.isOnline())
+        if (!isOnline())
             return localTunings[note].freq;
         
+        // ratio() and semitones() compare against the table themselves, so nothing needs caching here
         if ((!supportsNoteFiltering || supportsMultiChannelNoteFiltering) &&
             supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[channel])
+            useMultiChannelTuning(midichannel) &&
+            multi_channel_esp_retuning[channel])
+        {
+            return multi_channel_esp_retuning[channel][note];
+        }
+        
+        return esp_retuning[note];
+    }
+    
+    // copies the frequencies of all 128 notes, as freq() would return them
+    inline void freqs(double *out, char midichannel)
+    {
+        int channel = midichannel & 15;
+        
+        freqRequestReceived = true;
+        supportsMultiChannelTuning = !(midichannel & ~15);
+        
+        const double *table = localFreqs;
+        if (isOnline())
+        {
+            table = esp_retuning;
+            if ((!supportsNoteFiltering || supportsMultiChannelNoteFiltering) &&
+                supportsMultiChannelTuning &&
+                useMultiChannelTuning(midichannel) &&
+                multi_channel_esp_retuning[channel])
+            {
+                table = multi_channel_esp_retuning[channel];
+            }
+        }
+        
+        memcpy(out, table, 128 * sizeof(double));
+    }
+    
+    // MTS_GetTuningVersion(): also brings the note indexes built so far up to date, so that
+    // frequency-to-note lookups of the same block only search
+    inline unsigned int pollTuningVersion()
+    {
+        const unsigned int previous = polledVersion.load(std::memory_order_relaxed);
+        const unsigned int v = tuningVersion();
+        if (v != previous)
         {
-            globalMultichannelTunings[channel][note].freq = global.multi_channel_esp_retuning[channel][note];
-            globalMultichannelTunings[channel][note].flags = 0;
-            return globalMultichannelTunings[channel][note].freq;
+            const int used = noteIndexesUsed.load(std::memory_order_relaxed);
+            for (int slot = 0; slot < eNumNoteIndexes; slot++)
+                if (used & (1 << slot))
+                    buildNoteIndex(slot, v);
+        }
+        polledVersion.store(v, std::memory_order_release);
+        return v;
+    }
+    
+    // the version lookups use: the polled one, or for clients that never poll, a fresh one
+    inline unsigned int lookupVersion()
+    {
+        const unsigned int v = polledVersion.load(std::memory_order_acquire);
+        return v ? v : tuningVersion();
+    }
+    
+    // increases whenever any table this client reads from, or a note filter its lookups use, has changed since the last call. never returns 0
+    inline unsigned int tuningVersion()
+    {
+        bool online = isOnline();
+        int channels = 0;
+        if (online)
+        {
+            for (int i = 0; i < 16; i++)
+                if (multi_channel_esp_retuning[i] && useMultiChannelTuning(static_cast<char>(i)))
+                    channels |= 1 << i;
+        }
+        
+        bool changed = localTuningChanged || online != versionOnline || channels != versionChannels;
+        localTuningChanged = false;
+        versionOnline = online;
+        versionChannels = channels;
+        
+        if (online)
+        {
+            if (memcmp(versionFreqs, esp_retuning, sizeof(versionFreqs)))
+            {
+                memcpy(versionFreqs, esp_retuning, sizeof(versionFreqs));
+                changed = true;
+            }
+            
+            for (int i = 0; i < 16; i++)
+            {
+                if (!(channels & (1 << i)) || !memcmp(versionMultiChannelFreqs[i], multi_channel_esp_retuning[i], sizeof(versionMultiChannelFreqs[i])))
+                    continue;
+                memcpy(versionMultiChannelFreqs[i], multi_channel_esp_retuning[i], sizeof(versionMultiChannelFreqs[i]));
+                changed = true;
+            }
+            
+            // the note indexes depend on the filters too, e.g. a new keyboard mapping with the same frequencies.
+            // checked for channel -1, every channel looked up so far and the multi-channel tables in use
+            if (global().ShouldFilterNote || global().ShouldFilterNoteMultiChannel)
+            {
+                const int used = noteIndexesUsed.load(std::memory_order_relaxed) | (1 << eUnknownChannelIndex);
+                for (int slot = 0; slot <= eUnknownChannelIndex; slot++)
+                {
+                    if (!(used & (1 << slot)))
+                        continue;
+                    const int ch = slot == eUnknownChannelIndex ? -1 : slot;
+                    const bool multiChannel = ch >= 0 && (channels & (1 << ch));
+                    changed |= updateFilter(versionFilters[slot], [multiChannel, ch](int note) {return filterSingle(true, multiChannel, note, ch);});
+                }
+                if (used & (1 << eMultiChannelIndex))
+                    for (int i = 0; i < 16; i++)
+                        if (channels & (1 << i))
+                            changed |= updateFilter(versionMultiChannelFilters[i], [i](int note) {return filterMultiChannel(note, i);});
+            }
         }
         
-        globalTunings[note].freq = global.esp_retuning[note];
-        globalTunings[note].flags = 0;
-        return globalTunings[note].freq;
+        if (changed && !++version)
+            version = 1;
+        return version;
     }
     
     inline double ratio(char midinote, char midichannel)
@@ -284,7 +545,7 @@ struct MTSClient
         freqRequestReceived = true;
         supportsMultiChannelTuning = !(midichannel & ~15);
         
-        if (!global.isOnline())
+        if (!isOnline())
         {
             if (!receivedMTSSysEx)
                 return 1.0;
@@ -292,18 +553,17 @@ struct MTSClient
             if (localTunings[note].flags & Tuning::eRatioValid)
                 return localTunings[note].ratio;
             
-            localTunings[note].ratio = localTunings[note].freq * global.iet[note];
+            localTunings[note].ratio = localTunings[note].freq * global().iet[note];
             localTunings[note].flags |= Tuning::eRatioValid;
             return localTunings[note].ratio;
         }
         
         if ((!supportsNoteFiltering || supportsMultiChannelNoteFiltering) &&
             supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[channel])
+            useMultiChannelTuning(midichannel) &&
+            multi_channel_esp_retuning[channel])
         {
-            double freq = global.multi_channel_esp_retuning[channel][note];
+            double freq = multi_channel_esp_retuning[channel][note];
             
             if (globalMultichannelTunings[channel][note].freq == freq &&
                 (globalMultichannelTunings[channel][note].flags & Tuning::eRatioValid))
@@ -311,13 +571,13 @@ struct MTSClient
                 return globalMultichannelTunings[channel][note].ratio;
             }
             
-            globalMultichannelTunings[channel][note].freq = global.multi_channel_esp_retuning[channel][note];
-            globalMultichannelTunings[channel][note].ratio = globalMultichannelTunings[channel][note].freq * global.iet[note];
+            globalMultichannelTunings[channel][note].freq = multi_channel_esp_retuning[channel][note];
+            globalMultichannelTunings[channel][note].ratio = globalMultichannelTunings[channel][note].freq * global().iet[note];
             globalMultichannelTunings[channel][note].flags = Tuning::eRatioValid;
             return globalMultichannelTunings[channel][note].ratio;
         }
         
-        double freq = global.esp_retuning[note];
+        double freq = esp_retuning[note];
         
         if (globalTunings[note].freq == freq &&
             (globalTunings[note].flags & Tuning::eRatioValid))
@@ -325,8 +585,8 @@ struct MTSClient
             return globalTunings[note].ratio;
         }
         
-        globalTunings[note].freq = global.esp_retuning[note];
-        globalTunings[note].ratio = globalTunings[note].freq * global.iet[note];
+        globalTunings[note].freq = esp_retuning[note];
+        globalTunings[note].ratio = globalTunings[note].freq * global().iet[note];
         globalTunings[note].flags = Tuning::eRatioValid;
         return globalTunings[note].ratio;
     }
@@ -339,7 +599,7 @@ struct MTSClient
         freqRequestReceived = true;
         supportsMultiChannelTuning = !(midichannel & ~15);
         
-        if (!global.isOnline())
+        if (!isOnline())
         {
             if (!receivedMTSSysEx)
                 return 0.0;
@@ -354,7 +614,7 @@ struct MTSClient
                 return localTunings[note].semitones;
             }
             
-            localTunings[note].ratio = localTunings[note].freq * global.iet[note];
+            localTunings[note].ratio = localTunings[note].freq * global().iet[note];
             localTunings[note].semitones = ratioToSemitones * log(localTunings[note].ratio);
             localTunings[note].flags |= Tuning::eRatioValid | Tuning::eSemitonesValid;
             return localTunings[note].semitones;
@@ -362,11 +622,10 @@ struct MTSClient
         
         if ((!supportsNoteFiltering || supportsMultiChannelNoteFiltering) &&
             supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[channel])
+            useMultiChannelTuning(midichannel) &&
+            multi_channel_esp_retuning[channel])
         {
-            double freq = global.multi_channel_esp_retuning[channel][note];
+            double freq = multi_channel_esp_retuning[channel][note];
             
             if (globalMultichannelTunings[channel][note].freq == freq)
             {
@@ -382,13 +641,13 @@ struct MTSClient
             }
             
             globalMultichannelTunings[channel][note].freq = freq;
-            globalMultichannelTunings[channel][note].ratio = freq * global.iet[note];
+            globalMultichannelTunings[channel][note].ratio = freq * global().iet[note];
             globalMultichannelTunings[channel][note].semitones = ratioToSemitones * log(globalMultichannelTunings[channel][note].ratio);
             globalMultichannelTunings[channel][note].flags = Tuning::eRatioValid | Tuning::eSemitonesValid;
             return globalMultichannelTunings[channel][note].semitones;
         }
         
-        double freq = global.esp_retuning[note];
+        double freq = esp_retuning[note];
         
         if (globalTunings[note].freq == freq)
         {
@@ -404,7 +663,7 @@ struct MTSClient
         }
         
         globalTunings[note].freq = freq;
-        globalTunings[note].ratio = freq * global.iet[note];
+        globalTunings[note].ratio = freq * global().iet[note];
         globalTunings[note].semitones = ratioToSemitones * log(globalTunings[note].ratio);
         globalTunings[note].flags = Tuning::eRatioValid | Tuning::eSemitonesValid;
         return globalTunings[note].semitones;
@@ -418,399 +677,410 @@ struct MTSClient
         if (!freqRequestReceived)
             supportsMultiChannelTuning = supportsMultiChannelNoteFiltering; // assume it supports multi channel tuning until a request is received for a frequency and can verify
         
-        if (!global.isOnline())
+        if (!isOnline())
             return false;
         
         if (supportsMultiChannelNoteFiltering &&
             supportsMultiChannelTuning &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel))
+            useMultiChannelTuning(midichannel))
         {
-            return global.ShouldFilterNoteMultiChannel ? global.ShouldFilterNoteMultiChannel(midinote & 127, midichannel) : false;
+            return global().ShouldFilterNoteMultiChannel ? global().ShouldFilterNoteMultiChannel(midinote & 127, midichannel) : false;
         }
         
-        return global.ShouldFilterNote ? global.ShouldFilterNote(midinote & 127, midichannel) : false;
+        return global().ShouldFilterNote ? global().ShouldFilterNote(midinote & 127, midichannel) : false;
     }
     
-    inline char freqToNote(double freq, char midichannel)
+    // the tables a single channel lookup searches: midichannel's multi-channel table if in use, else the regular one
+    inline const double *noteTable(char midichannel, bool &online, bool &multiChannel)
     {
-        bool online = global.isOnline();
-        bool multiChannel = false;
-        const double *freqs = online ? global.esp_retuning : localFreqs;
-        
-        if (online &&
+        online = isOnline();
+        multiChannel = online &&
             !(midichannel & ~15) &&
-            global.UseMultiChannelTuning &&
-            global.UseMultiChannelTuning(midichannel) &&
-            global.multi_channel_esp_retuning[midichannel & 15])
+            useMultiChannelTuning(midichannel) &&
+            multi_channel_esp_retuning[midichannel & 15];
+        if (multiChannel)
+            return multi_channel_esp_retuning[midichannel & 15];
+        return online ? esp_retuning : localFreqs;
+    }
+    
+    // stored, filter(note)
+    // true if the notes the filter leaves out differ from the stored ones, which are updated then
+    template<typename Filter>
+    static bool updateFilter(unsigned long long *stored, const Filter &shouldFilter)
+    {
+        unsigned long long filter[2] = {0, 0};
+        for (int note = 0; note < 128; note++)
+            if (shouldFilter(note))
+                filter[note >> 6] |= 1ull << (note & 63);
+        if (!memcmp(filter, stored, sizeof(filter)))
+            return false;
+        memcpy(stored, filter, sizeof(filter));
+        return true;
+    }
+    
+    // the multi-channel tables in use, and their channels
+    inline int multiChannelTables(const double **tables, int *channels)
+    {
+        int n = 0;
+        if (isOnline())
+            for (int i = 0; i < 16; i++)
+                if (useMultiChannelTuning(static_cast<char>(i)) && multi_channel_esp_retuning[i])
+                {
+                    channels[n] = i;
+                    tables[n++] = multi_channel_esp_retuning[i];
+                }
+        return n;
+    }
+    
+    static bool filterSingle(bool online, bool multiChannel, int note, int ch)
+    {
+        if (!online)
+            return false;
+        if (multiChannel)
+            return global().ShouldFilterNoteMultiChannel && global().ShouldFilterNoteMultiChannel(static_cast<char>(note), static_cast<char>(ch));
+        return global().ShouldFilterNote && global().ShouldFilterNote(static_cast<char>(note), static_cast<char>(ch));
+    }
+    
+    static bool filterMultiChannel(int note, int ch)
+    {
+        return global().ShouldFilterNoteMultiChannel && global().ShouldFilterNoteMultiChannel(static_cast<char>(note), static_cast<char>(ch));
+    }
+    
+    // slot: a midi channel, eUnknownChannelIndex or eMultiChannelIndex
+    inline bool buildNoteIndex(int slot, unsigned int v)
+    {
+        if (slot == eMultiChannelIndex)
         {
-            freqs = global.multi_channel_esp_retuning[midichannel & 15];
-            multiChannel = true;
+            const double *tables[16];
+            int channels[16];
+            const int n = multiChannelTables(tables, channels);
+            return multiChannelNoteIndex.build(tables, channels, n, v, filterMultiChannel);
         }
+        const char midichannel = static_cast<char>(slot == eUnknownChannelIndex ? -1 : slot);
+        bool online, multiChannel;
+        const double *table = noteTable(midichannel, online, multiChannel);
+        const int channel = midichannel;
+        return noteIndexes[slot].build(&table, &channel, 1, v, [online, multiChannel](int note, int ch) {return filterSingle(online, multiChannel, note, ch);});
+    }
+    
+    // each channel has its own index, so alternating channels don't rebuild anything.
+    // an index is built on its first lookup and from then on rebuilt by pollTuningVersion()
+    inline char freqToNote(double freq, char midichannel)
+    {
+        const int slot = (midichannel & ~15) ? static_cast<int>(eUnknownChannelIndex) : midichannel;
+        const unsigned int v = lookupVersion();
+        int entry = noteIndexes[slot].nearest(freq, v);
+        if (entry == MTSNoteIndex<1>::eStale)
+        {
+            noteIndexesUsed.fetch_or(1 << slot, std::memory_order_relaxed);
+            if (buildNoteIndex(slot, v))
+                entry = noteIndexes[slot].nearest(freq, v);
+        }
+        if (entry == MTSNoteIndex<1>::eStale)
+        {
+            // another thread is building it
+            bool online, multiChannel;
+            const double *table = noteTable(midichannel, online, multiChannel);
+            const int channel = midichannel;
+            entry = nearestNoteLinear(&table, &channel, 1, freq, [online, multiChannel](int note, int ch) {return filterSingle(online, multiChannel, note, ch);});
+        }
+        return entry < 0 ? static_cast<char>(0) : static_cast<char>(entry & 127);
+    }
+    
+    inline char freqToNote(double freq, char *midichannel)
+    {
+        if (!midichannel) 
+            return freqToNote(freq, static_cast<char>(-1));
         
-        int iLower = 0;
-        int iUpper = 0;
-        double dLower = 0.0;
-        double dUpper = 0.0;
-        
-        for (int i = 0; i < 128; i++)
+        const double *tables[16];
+        int channels[16];
+        const int nMultiChannels = multiChannelTables(tables, channels);
+        if (nMultiChannels > 0)
         {
-            if (online)
+            const unsigned int v = lookupVersion();
+            int entry = multiChannelNoteIndex.nearest(freq, v);
+            if (entry == MTSNoteIndex<16>::eStale)
             {
-                if (multiChannel && 
-                    global.ShouldFilterNoteMultiChannel &&
-                    global.ShouldFilterNoteMultiChannel(static_cast<char>(i), midichannel))
-                {
-                    continue;
-                }
-                
-                if (!multiChannel &&
-                    global.ShouldFilterNote &&
-                    global.ShouldFilterNote(static_cast<char>(i), midichannel))
-                {
-                    continue;
-                }
+                noteIndexesUsed.fetch_or(1 << eMultiChannelIndex, std::memory_order_relaxed);
+                if (buildNoteIndex(eMultiChannelIndex, v))
+                    entry = multiChannelNoteIndex.nearest(freq, v);
             }
+            int channel = 0;
+            if (entry == MTSNoteIndex<16>::eStale)
+            {
+                entry = nearestNoteLinear(tables, channels, nMultiChannels, freq, filterMultiChannel);
+                channel = channels[entry < 0 ? 0 : entry >> 7];
+            }
+            else
+                channel = entry < 0 ? channels[0] : multiChannelNoteIndex.channel(entry);
             
-            double d = freqs[i] - freq;
-            
-            if (d == 0.0)
-                return static_cast<char>(i);
-            
-            if (d < 0.0)
+            *midichannel = static_cast<char>(channel);
+            return entry < 0 ? static_cast<char>(0) : static_cast<char>(entry & 127);
+        }
+        
+        *midichannel = static_cast<char>(0);
+        return freqToNote(freq, static_cast<char>(0));
+    }
+    
+    // Parsing is resumable: a message may be split across any number of calls and continues where the previous call stopped.
+    // A status byte 0xF0 always starts a new message, 0xF7 ends it, any other status byte (e.g. interleaved real-time messages) is skipped.
+    inline void parseMIDIData(const unsigned char *buffer, int len)
+    {
+        int i = 0;
+        while (i < len)
+        {
+            if (sysexState == eIgnoring && buffer[i] == 0xF0)
             {
-                if (dLower == 0.0 || d > dLower)
+                int size = parseBulkDump(buffer + i, len - i);
+                if (size)
                 {
-                    dLower=d;
-                    iLower=i;
+                    i += size;
+                    continue;
                 }
             }
-            else if (dUpper == 0.0 || d < dUpper)
-            {
-                dUpper = d;
-                iUpper = i;
-            }
+            parseByte(buffer[i++]);
         }
+    }
+    
+    // Fast path for a complete, unfragmented bulk dump (formats 1 and 4) at the start of data. Returns the bytes consumed, or 0 to fall back to the state machine.
+    inline int parseBulkDump(const unsigned char *data, int len)
+    {
+        enum {eMinSize = 6 + 16 + 3 * 128 + 2};
+        if (len < eMinSize || (data[1] != 0x7E && data[1] != 0x7F) || data[3] != 0x08)
+            return 0;
+        
+        int header = 0;
+        if (data[4] == 0x01)
+            header = 6; // F0, 7E/7F, device id, 08, 01, prog
+        else if (data[4] == 0x04)
+            header = 7; // F0, 7E/7F, device id, 08, 04, bank, prog
+        else
+            return 0;
+        
+        const int size = header + 16 + 3 * 128 + 2; // name, tuning data, checksum, F7
+        if (len < size || data[size - 1] != 0xF7)
+            return 0;
+        for (int i = 1; i < size - 1; i++)
+            if (data[i] & 0x80)
+                return 0;
         
-        if (dLower == 0.0)
-            return static_cast<char>(iUpper);
+        memcpy(tuningName, data + header, 16);
+        tuningName[16] = '\0';
         
-        if (dUpper == 0.0 || iLower == iUpper)
-            return static_cast<char>(iLower);
+        const unsigned char *d = data + header + 16;
+        for (int note = 0; note < 128; note++, d += 3)
+        {
+            int value = (d[0] << 14) | (d[1] << 7) | d[2];
+            if (!(note == 0x7F && value == 16383))
+                updateTuning(note, d[0], (value & 16383) / 16383.0);
+        }
         
-        double fmid = freqs[iLower] * pow(2.0, 0.5 * (log(freqs[iUpper] / freqs[iLower]) / ln2));
-        return freq < fmid ? static_cast<char>(iLower) : static_cast<char>(iUpper);
+        mapSizeLocal = static_cast<char>(-1);
+        mapStartKeyLocal = static_cast<char>(-1);
+        return size;
     }
     
-    inline char freqToNote(double freq, char *midichannel)
+    inline void parseByte(unsigned char b)
     {
-        if (!midichannel) 
-            return freqToNote(freq, static_cast<char>(-1));
+        if (b == 0xF0)
+        {
+            sysexState = eMatchingSysex;
+            sysexCtr = 0;
+            sysexValue = 0;
+            sysexNote = 0;
+            return;
+        }
         
-        if (global.isOnline() && global.UseMultiChannelTuning)
+        if (b == 0xF7)
         {
-            int channelsInUse[16];
-            int nMultiChannels = 0;
-            for (int i = 0; i < 16; i++)
-                if (global.UseMultiChannelTuning(static_cast<char>(i)) && global.multi_channel_esp_retuning[i])
-                    channelsInUse[nMultiChannels++] = i;
-            
-            if (nMultiChannels > 0)
-            {
-                const int nFreqs = 128 * nMultiChannels;
-                int iLower = 0;
-                int iUpper = 0;
-                int channel = 0;
-                int note = 0;
-                double dLower = 0.0;
-                double dUpper = 0.0;
-                
-                for (int i = 0; i < nFreqs; i++)
+            sysexState = eIgnoring;
+            return;
+        }
+        
+        if (b > 0x7F)
+            return;
+        
+        switch (sysexState)
+        {
+            case eIgnoring:
+                break;
+            case eMatchingSysex:
+                sysexCtr = 0;
+                if (b == 0x7E || b == 0x7F) // non-real-time / real-time
+                    sysexState = eSysexValid;
+                else
+                    sysexState = eIgnoring;
+                break;
+            case eSysexValid:
+                switch (sysexCtr++) // handle device ID
                 {
-                    channel = channelsInUse[i >> 7];
-                    note = i & 127;
-                    
-                    if (global.ShouldFilterNoteMultiChannel &&
-                        global.ShouldFilterNoteMultiChannel(static_cast<char>(note), static_cast<char>(channel)))
-                    {
-                        continue;
-                    }
-                    
-                    double d = global.multi_channel_esp_retuning[channel][note] - freq;
-                    
-                    if (d == 0.0)
-                    {
-                        *midichannel = static_cast<char>(channel);
-                        return static_cast<char>(note);
-                    }
-                    
-                    if (d < 0.0)
-                    {
-                        if (dLower == 0.0 || d > dLower)
-                        {
-                            dLower = d;
-                            iLower = i;
-                        }
-                    }
-                    else if (dUpper == 0.0 || d < dUpper)
-                    {
-                        dUpper = d;
-                        iUpper = i;
-                    }
+                    case 0:
+                        break;
+                    case 1:
+                        if (b == 0x08)
+                            sysexState = eMatchingMTS;
+                        break;
+                    default: // it's not an MTS message
+                        sysexState = eIgnoring;
+                        break;
                 }
-                
-                if (dLower==0.0) 
+                break;
+            case eMatchingMTS:
+                sysexCtr = 0;
+                switch (b)
                 {
-                    *midichannel = static_cast<char>(channelsInUse[iUpper >> 7]);
-                    return static_cast<char>(iUpper & 127);
+                    case 0:
+                        sysexFormat = eRequest;
+                        sysexState = eMatchingProg;
+                        break;
+                    case 1:
+                        sysexFormat = eBulk;
+                        sysexState = eMatchingProg;
+                        break;
+                    case 2:
+                        sysexFormat = eSingle;
+                        sysexState = eMatchingProg;
+                        break;
+                    case 3:
+                        sysexFormat = eRequest;
+                        sysexState = eMatchingBank;
+                        break;
+                    case 4:
+                        sysexFormat = eBulk;
+                        sysexState = eMatchingBank;
+                        break;
+                    case 5:
+                        sysexFormat = eScaleOctOneByte;
+                        sysexState = eMatchingBank;
+                        break;
+                    case 6:
+                        sysexFormat = eScaleOctTwoByte;
+                        sysexState = eMatchingBank;
+                        break;
+                    case 7:
+                        sysexFormat = eSingle;
+                        sysexState = eMatchingBank;
+                        break;
+                    case 8:
+                        sysexFormat = eScaleOctOneByteExt;
+                        sysexState = eMatchingChannel;
+                        break;
+                    case 9:
+                        sysexFormat = eScaleOctTwoByteExt;
+                        sysexState = eMatchingChannel;
+                        break;
+                    default: // it's not a valid MTS format
+                        sysexState = eIgnoring;
+                        break;
                 }
-                
-                if (dUpper == 0.0 || iLower == iUpper)
+                break;
+            case eMatchingBank:
+                sysexState = eMatchingProg;
+                break;
+            case eMatchingProg:
+                if (sysexFormat == eRequest)
                 {
-                    *midichannel = static_cast<char>(channelsInUse[iLower >> 7]);
-                    return static_cast<char>(iLower & 127);
+                    sysexState = eIgnoring;
                 }
-                
-                double fLower = global.multi_channel_esp_retuning[channelsInUse[iLower >> 7]][iLower & 127];
-                double fUpper = global.multi_channel_esp_retuning[channelsInUse[iUpper >> 7]][iUpper & 127];
-                double fmid = fLower * pow(2.0, 0.5 * (log(fUpper / fLower) / ln2));
-                
-                if (freq < fmid)
+                else if (sysexFormat == eSingle)
                 {
-                    *midichannel = static_cast<char>(channelsInUse[iLower >> 7]);
-                    return static_cast<char>(iLower & 127);
+                    sysexState = eNumTunings;
                 }
-                
-                *midichannel = static_cast<char>(channelsInUse[iUpper >> 7]);
-                return static_cast<char>(iUpper & 127);
-            }
+                else
+                {
+                    sysexState = eTuningName;
+                    tuningName[0] = '\0';
+                }
+                break;
+            case eTuningName:
+                tuningName[sysexCtr] = static_cast<char>(b);
+                if (++sysexCtr >= 16)
+                {
+                    tuningName[16] = '\0';
+                    beginTuningData();
+                }
+                break;
+            case eNumTunings:
+                sysexNumTunings = b;
+                beginTuningData();
+                break;
+            case eMatchingChannel: // channel bitmap, 3 bytes
+                if (++sysexCtr >= 3)
+                    beginTuningData();
+                break;
+            case eTuningData:
+                parseTuningData(b);
+                break;
+            case eCheckSum:
+                sysexState = eIgnoring;
+                break;
         }
-        
-        *midichannel = static_cast<char>(0);
-        return freqToNote(freq, static_cast<char>(0));
     }
     
-    inline void parseMIDIData(const unsigned char *buffer, int len)
+    inline void beginTuningData()
     {
-        int sysex_ctr = 0;
-        int sysex_value = 0;
-        int note = 0;
-        int numTunings = 0;
-        /*int bank = -1, prog = 0, checksum = 0, deviceID = 0; short int channelBitmap = 0; bool realtime = false;*/ // unused for now
+        sysexCtr = 0;
+        sysexValue = 0;
+        sysexNote = 0;
+        sysexState = eTuningData;
         
-        eSysexState state = eIgnoring;
-        eMTSFormat format = eBulk;
-        for (int i = 0; i < len; i++)
-        {
-            unsigned char b = buffer[i];
-            if (b == 0xF7)
-            {
-                state = eIgnoring;
-                continue;
-            }
-            
-            if (b > 0x7F && b != 0xF0)
-                continue;
-            
-            switch (state)
-            {
-                case eIgnoring:
-                    if (b == 0xF0)
-                        state = eMatchingSysex;
-                    break;
-                case eMatchingSysex:
-                    sysex_ctr = 0;
-                    if (b == 0x7E)
-                        state = eSysexValid;
-                    else if (b == 0x7F)
-                    {
-                        /*realtime = true;*/
-                        state = eSysexValid;
-                    }
-                    else 
-                    {
-                        state = eIgnoring;
-                    }
-                    break;
-                case eSysexValid:
-                    switch (sysex_ctr++) // handle device ID
-                    {
-                        case 0:
-                            /*deviceID = b;*/
-                            break;
-                        case 1: 
-                            if (b == 0x08)
-                                state = eMatchingMTS;
-                            break;
-                        default: // it's not an MTS message
-                            state = eIgnoring;
-                            break;
-                    }
-                    break;
-                case eMatchingMTS:
-                    sysex_ctr = 0;
-                    switch (b)
-                    {
-                        case 0: 
-                            format = eRequest;
-                            state = eMatchingProg;
-                            break;
-                        case 1: 
-                            format = eBulk;
-                            state = eMatchingProg;
-                            break;
-                        case 2: 
-                            format = eSingle;
-                            state = eMatchingProg;
-                            break;
-                        case 3: 
-                            format = eRequest; 
-                            state = eMatchingBank; 
-                            break;
-                        case 4:
-                            format = eBulk; 
-                            state = eMatchingBank; 
-                            break;
-                        case 5:
-                            format = eScaleOctOneByte; 
-                            state = eMatchingBank; 
-                            break;
-                        case 6:
-                            format = eScaleOctTwoByte; 
-                            state = eMatchingBank; 
-                            break;
-                        case 7:
-                            format = eSingle; 
-                            state = eMatchingBank; 
-                            break;
-                        case 8:
-                            format = eScaleOctOneByteExt; 
-                            state = eMatchingChannel; 
-                            break;
-                        case 9:
-                            format = eScaleOctTwoByteExt; 
-                            state = eMatchingChannel; 
-                            break;
-                        default: // it's not a valid MTS format
-                            state = eIgnoring;
-                            break;
-                    }
-                    break;
-                case eMatchingBank:
-                    /*bank = b;*/
-                    state = eMatchingProg;
-                    break;
-                case eMatchingProg:
-                    /*prog = b;*/
-                    if (format == eSingle)
-                    {
-                        state = eNumTunings;
-                    }
-                    else
-                    {
-                        state = eTuningName;
-                        tuningName[0] = '\0';
-                    }
-                    break;
-                case eTuningName:
-                    tuningName[sysex_ctr] = static_cast<char>(b);
-                    if (++sysex_ctr >= 16)
-                    {
-                        tuningName[16] = '\0';
-                        sysex_ctr = 0;
-                        state = eTuningData;
-                    }
-                    break;
-                case eNumTunings:
-                    numTunings = b;
-                    sysex_ctr = 0;
-                    state = eTuningData;
-                    break;
-                case eMatchingChannel:
-                    switch (sysex_ctr++)
-                    {
-                        case 0: 
-                            /*for (int j = 14; j < 16; j++) channelBitmap |= (1 << j);*/
-                            break;
-                        case 1: 
-                            /*for (int j = 7; j < 14; j++) channelBitmap |= (1 << j);*/
-                            break;
-                        case 2: 
-                            /*for (int j = 0; j < 7; j++) channelBitmap |= (1 << j);*/
-                            sysex_ctr = 0;
-                            state = eTuningData;
-                            break;
-                    }
-                    break;
-                case eTuningData:
-                    switch (format)
-                    {
-                        case eBulk:
-                            sysex_value = (sysex_value << 7) | b;
-                            sysex_ctr++;
-                            if ((sysex_ctr & 3) == 3)
-                            {
-                                if (!(note == 0x7F && sysex_value == 16383))
-                                    updateTuning(note, (sysex_value >> 14) & 127, (sysex_value & 16383) / 16383.0);
-                                sysex_value = 0;
-                                sysex_ctr++;
-                                if (++note >= 128)
-                                    state = eCheckSum;
-                            }
-                            break;
-                        case eSingle:
-                            sysex_value = (sysex_value << 7) | b;
-                            sysex_ctr++;
-                            if (!(sysex_ctr & 3))
-                            {
-                                if (!(note == 0x7F && sysex_value == 16383))
-                                    updateTuning((sysex_value >> 21) & 127, (sysex_value >> 14) & 127, (sysex_value & 16383) / 16383.0);
-                                sysex_value = 0;
-                                if (++note >= numTunings)
-                                    state = eIgnoring;
-                            }
-                            break;
-                        case eScaleOctOneByte: 
-                        case eScaleOctOneByteExt:
-                            for (int j = sysex_ctr; j < 128; j += 12)
-                                updateTuning(j, j, (static_cast<double>(b) - 64.0) * 0.01);
-                            if (++sysex_ctr >= 12)
-                                state = format == eScaleOctOneByte ? eCheckSum : eIgnoring;
-                            break;
-                        case eScaleOctTwoByte: 
-                        case eScaleOctTwoByteExt:
-                            sysex_value = (sysex_value << 7) | b;
-                            sysex_ctr++;
-                            if (!(sysex_ctr & 1))
-                            {
-                                double detune = (static_cast<double>(sysex_value & 16383) - 8192.0) / (sysex_value > 8192 ? 8191.0 : 8192.0);
-                                for (int j = note; j < 128; j += 12)
-                                    updateTuning(j, j, detune);
-                                if (++note >= 12)
-                                    state = format == eScaleOctTwoByte ? eCheckSum : eIgnoring;
-                            }
-                            break;
-                        default: 
-                            state = eIgnoring;
-                            break;
-                    }
-                    break;
-                case eCheckSum:
-                    /*checksum = b;*/
-                    state = eIgnoring;
-                    break;
-            }
-        }
-        
-        if (format == eScaleOctOneByte || format == eScaleOctTwoByte || format == eScaleOctOneByteExt || format == eScaleOctTwoByteExt)
-        {
-            mapSizeLocal = static_cast<char>(12);
-            mapStartKeyLocal = static_cast<char>(60);
-        }
-        else
+        bool scaleOct = sysexFormat == eScaleOctOneByte || sysexFormat == eScaleOctTwoByte || sysexFormat == eScaleOctOneByteExt || sysexFormat == eScaleOctTwoByteExt;
+        mapSizeLocal = static_cast<char>(scaleOct ? 12 : -1);
+        mapStartKeyLocal = static_cast<char>(scaleOct ? 60 : -1);
+    }
+    
+    inline void parseTuningData(unsigned char b)
+    {
+        switch (sysexFormat)
         {
-            mapSizeLocal = static_cast<char>(-1);
-            mapStartKeyLocal = static_cast<char>(-1);
+            case eBulk:
+                sysexValue = (sysexValue << 7) | b;
+                if (++sysexCtr == 3)
+                {
+                    if (!(sysexNote == 0x7F && sysexValue == 16383))
+                        updateTuning(sysexNote, (sysexValue >> 14) & 127, (sysexValue & 16383) / 16383.0);
+                    sysexValue = 0;
+                    sysexCtr = 0;
+                    if (++sysexNote >= 128)
+                        sysexState = eCheckSum;
+                }
+                break;
+            case eSingle:
+                sysexValue = (sysexValue << 7) | b;
+                if (++sysexCtr == 4)
+                {
+                    if (!(sysexNote == 0x7F && sysexValue == 16383))
+                        updateTuning((sysexValue >> 21) & 127, (sysexValue >> 14) & 127, (sysexValue & 16383) / 16383.0);
+                    sysexValue = 0;
+                    sysexCtr = 0;
+                    if (++sysexNote >= sysexNumTunings)
+                        sysexState = eIgnoring;
+                }
+                break;
+            case eScaleOctOneByte:
+            case eScaleOctOneByteExt:
+                for (int j = sysexCtr; j < 128; j += 12)
+                    updateTuning(j, j, (static_cast<double>(b) - 64.0) * 0.01);
+                if (++sysexCtr >= 12)
+                    sysexState = sysexFormat == eScaleOctOneByte ? eCheckSum : eIgnoring;
+                break;
+            case eScaleOctTwoByte:
+            case eScaleOctTwoByteExt:
+                sysexValue = (sysexValue << 7) | b;
+                if (++sysexCtr == 2)
+                {
+                    double detune = (static_cast<double>(sysexValue & 16383) - 8192.0) / (sysexValue > 8192 ? 8191.0 : 8192.0);
+                    for (int j = sysexNote; j < 128; j += 12)
+                        updateTuning(j, j, detune);
+                    sysexValue = 0;
+                    sysexCtr = 0;
+                    if (++sysexNote >= 12)
+                        sysexState = sysexFormat == eScaleOctTwoByte ? eCheckSum : eIgnoring;
+                }
+                break;
+            default:
+                sysexState = eIgnoring;
+                break;
         }
     }
     
@@ -819,19 +1089,30 @@ struct MTSClient
         if (note < 0 || note > 127 || retuneNote < 0 || retuneNote > 127)
             return;
         receivedMTSSysEx = true;
-        localFreqs[note] = 440.0 * pow(2.0, ((retuneNote + detune) - 69.0) / 12.0);
+        localFreqs[note] = global().et[retuneNote] * detuneToRatio(detune);
         if (localFreqs[note] != localTunings[note].freq)
         {
             localTunings[note].freq = localFreqs[note];
             localTunings[note].flags = 0;
+            localTuningChanged = true;
         }
     }
     
     inline bool hasReceivedMTSSysEx() {return receivedMTSSysEx;}
     
-    const char *getScaleName() {return (global.isOnline() && global.GetScaleName) ? global.GetScaleName() : tuningName;}
+    const char *getScaleName()
+    {
+        if (fallback)
+            return isOnline() ? fallbackTuning.name : tuningName;
+        return (isOnline() && global().GetScaleName) ? global().GetScaleName() : tuningName;
+    }
     
-    double getPeriodRatio() {return (global.isOnline() && global.GetPeriodRatio) ? global.GetPeriodRatio() : 2.0;}
+    double getPeriodRatio()
+    {
+        if (fallback)
+            return isOnline() ? fallbackTuning.periodRatio : 2.0;
+        return (isOnline() && global().GetPeriodRatio) ? global().GetPeriodRatio() : 2.0;
+    }
     double getPeriodSemitones()
     {
         double periodRatio = getPeriodRatio();
@@ -843,10 +1124,26 @@ struct MTSClient
         return periodSemitones;
     }
     
-    char getMapSize() {return (global.isOnline() && global.GetMapSize) ? global.GetMapSize() : mapSizeLocal;}
-    char getMapStartKey() {return (global.isOnline() && global.GetMapStartKey) ? global.GetMapStartKey() : mapStartKeyLocal;}
-    char getRefKey() {return (global.isOnline() && global.GetRefKey) ? global.GetRefKey() : static_cast<char>(-1);}
+    char getMapSize()
+    {
+        if (fallback)
+            return isOnline() ? fallbackTuning.mapSize : mapSizeLocal;
+        return (isOnline() && global().GetMapSize) ? global().GetMapSize() : mapSizeLocal;
+    }
+    char getMapStartKey()
+    {
+        if (fallback)
+            return isOnline() ? fallbackTuning.mapStartKey : mapStartKeyLocal;
+        return (isOnline() && global().GetMapStartKey) ? global().GetMapStartKey() : mapStartKeyLocal;
+    }
+    char getRefKey()
+    {
+        if (fallback)
+            return isOnline() ? fallbackTuning.refKey : static_cast<char>(-1);
+        return (isOnline() && global().GetRefKey) ? global().GetRefKey() : static_cast<char>(-1);
+    }
     
+    enum {eUnknownChannelIndex = 16, eMultiChannelIndex, eNumNoteIndexes};
     enum eSysexState {eIgnoring = 0, eMatchingSysex, eSysexValid, eMatchingMTS, eMatchingBank, eMatchingProg, eMatchingChannel, eTuningName, eNumTunings, eTuningData, eCheckSum};
     enum eMTSFormat {eRequest = 0, eBulk, eSingle, eScaleOctOneByte, eScaleOctTwoByte, eScaleOctOneByteExt, eScaleOctTwoByteExt};
 
@@ -868,16 +1165,54 @@ struct MTSClient
     bool supportsMultiChannelTuning;
     bool freqRequestReceived;
     bool receivedMTSSysEx;
+    
+    // tuning version and the tables it was last checked against
+    unsigned int version;
+    bool versionOnline;
+    int versionChannels;
+    bool localTuningChanged;
+    double versionFreqs[128];
+    double versionMultiChannelFreqs[16][128];
+    // notes left out by the filter of each single-channel index, and of each multi-channel table
+    unsigned long long versionFilters[16 + 1][2];
+    unsigned long long versionMultiChannelFilters[16][2];
+    // the version of the last MTS_GetTuningVersion() call, 0 if the client never polled
+    std::atomic<unsigned int> polledVersion;
+    
+    // sysex parser state, kept between calls
+    eSysexState sysexState;
+    eMTSFormat sysexFormat;
+    int sysexCtr;
+    int sysexValue;
+    int sysexNote;
+    int sysexNumTunings;
+    
+    // one per midi channel and one for channel -1
+    MTSNoteIndex<1> noteIndexes[16 + 1];
+    MTSNoteIndex<16> multiChannelNoteIndex;
+    // bitmask of the slots looked up so far, pollTuningVersion() keeps them up to date
+    std::atomic<int> noteIndexesUsed;
+    
+    // the tuning source if libMTS is missing, its version last copied (0 if none) and the copy
+    const MTSClientFallback *fallback;
+    unsigned long long fallbackVersion;
+    MTSFallbackTuning fallbackTuning;
+    // the tables this client reads while online: libMTS's, or the copy of the fallback's
+    const double *esp_retuning;
+    const double *multi_channel_esp_retuning[16];
 };
 
 static char freqToNoteET(double freq)
 {
     static double freqs[128];
+    static double mids[127];
     static bool init = false;
     if (!init)
     {
         for (int i = 0; i < 128; i++)
             freqs[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
+        for (int i = 0; i < 127; i++)
+            mids[i] = sqrt(freqs[i] * freqs[i + 1]);
         init = true;
     }
     
@@ -932,8 +1267,7 @@ static char freqToNoteET(double freq)
         n2 = t;
     }
     
-    double fmid = freqs[n] * pow(2.0, 0.5 * (log(freqs[n2] / freqs[n]) / ln2));
-    return freq < fmid ? static_cast<char>(n) : static_cast<char>(n2);
+    return freq < mids[n] ? static_cast<char>(n) : static_cast<char>(n2);
 }
 
 // exported functions:
@@ -942,7 +1276,9 @@ void MTS_DeregisterClient(MTSClient *c)
 bool MTS_HasMaster(MTSClient *c)                                                    {return c ? c->hasMaster() : false;}
 bool MTS_Client_ShouldUpdateLibrary(MTSClient *c)                                   {return c ? c->shouldUpdateLibrary() : false;}
 bool MTS_ShouldFilterNote(MTSClient *c, char midinote, char midichannel)            {return c ? c->shouldFilterNote(midinote & 127, midichannel) : false;}
-double MTS_NoteToFrequency(MTSClient *c, char midinote, char midichannel)           {return c ? c->freq(midinote, midichannel) : (1.0 / global.iet[midinote & 127]);}
+double MTS_NoteToFrequency(MTSClient *c, char midinote, char midichannel)           {return c ? c->freq(midinote, midichannel) : (1.0 / global().iet[midinote & 127]);}
+void MTS_NoteToFrequencies(MTSClient *c, double *freqs, char midichannel)           {if (c) c->freqs(freqs, midichannel); else for (int i = 0; i < 128; i++) freqs[i] = 1.0 / global().iet[i];}
+unsigned int MTS_GetTuningVersion(MTSClient *c)                                     {return c ? c->pollTuningVersion() : 1;}
 double MTS_RetuningAsRatio(MTSClient *c, char midinote, char midichannel)           {return c ? c->ratio(midinote, midichannel) : 1.0;}
 double MTS_RetuningInSemitones(MTSClient *c, char midinote, char midichannel)       {return c ? c->semitones(midinote, midichannel) : 0.0;}
 char MTS_FrequencyToNote(MTSClient *c, double freq, char midichannel)               {return c ? c->freqToNote(freq, midichannel) : freqToNoteET(freq);}
@@ -956,3 +1292,4 @@ char MTS_GetRefKey(MTSClient *c)
 void MTS_ParseMIDIDataU(MTSClient *c, const unsigned char *buffer, int len)         {if (c) c->parseMIDIData(buffer, len);}
 void MTS_ParseMIDIData(MTSClient *c, const char *buffer, int len)                   {if (c) c->parseMIDIData(reinterpret_cast<const unsigned char*>(buffer), len);}
 bool MTS_HasReceivedMTSSysEx(MTSClient *c)                                          {return c ? c->hasReceivedMTSSysEx() : false;}
+void MTS_SetClientFallback(const MTSClientFallback *fallback)                       {clientFallback.store(fallback);}
@@ -151,6 +151,13 @@ extern "C" {
     extern double MTS_RetuningInSemitones(MTSClient *client, char midinote, char midichannel);
     extern double MTS_RetuningAsRatio(MTSClient *client, char midinote, char midichannel);
     
+    // Copies the frequencies of all 128 notes into freqs in one call, as MTS_NoteToFrequency() would return them for the same MIDI channel.
+    extern void MTS_NoteToFrequencies(MTSClient *client, double *freqs, char midichannel);
+    // Returns a counter that increases whenever the tuning this client reads from has changed since the previous call (master tables, multi-channel tables in use or local MTS SysEx tuning).
+    // It never returns 0. Poll it once per block and only refetch frequencies when it differs from the last value seen.
+    // Once a client polls it, MTS_FrequencyToNote() and MTS_FrequencyToNoteAndChannel() search the tables as of the last poll, and their indexes are rebuilt here rather than during lookups.
+    extern unsigned int MTS_GetTuningVersion(MTSClient *client);
+    
     // MTS_FrequencyToNote() is a helper function returning the note number whose pitch is closest to the supplied frequency. Two versions are provided:
     // The first is for the simplest case: supply a frequency and get a note number back.
     // If you intend to use the returned note number to generate a note-on message on a specific, pre-determined MIDI channel, set the midichannel argument to the destination channel (0-15), else set to -1.
@@ -182,6 +189,30 @@ extern "C" {
     // Check if the client has received any valid MTS SysEx messages and will use local tuning if not connected to a master plug-in.
     extern bool MTS_HasReceivedMTSSysEx(MTSClient *client);
 
+    // A tuning source for clients when the libMTS dynamic library is not installed, e.g. a master publishing through shared memory.
+    // version() changes whenever the tuning changes and returns 0 while there is no live master. Clients call it on every query, so it must be cheap and must not block.
+    // read() copies a consistent tuning into the client's own table, false if none could be read. Clients call it when the version has changed.
+    typedef struct MTSFallbackTuning
+    {
+        double table[128];
+        double channelTables[16][128];
+        int channelsUsed; // bitmask of the multi-channel tables in use
+        double periodRatio;
+        char mapSize;
+        char mapStartKey;
+        char refKey;
+        char name[64];
+    } MTSFallbackTuning;
+    
+    typedef struct MTSClientFallback
+    {
+        unsigned long long (*version)(void);
+        bool (*read)(MTSFallbackTuning *tuning);
+    } MTSClientFallback;
+    
+    // Sets the tuning source of the clients registered from now on, 0 removes it. It must outlive them.
+    extern void MTS_SetClientFallback(const MTSClientFallback *fallback);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,122 @@
+#include "Allocations.h"
+#include "RealtimeCheck.h"
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+namespace alloc
+{
+	// zero-initialised tls, readable inside malloc without allocating
+	static thread_local juce::int64 count = 0;
+
+	juce::int64 getCount() noexcept
+	{
+		return count;
+	}
+
+#if defined(__GLIBC__)
+	bool isCountingMalloc() noexcept
+	{
+		return true;
+	}
+#else
+	bool isCountingMalloc() noexcept
+	{
+		return false;
+	}
+#endif
+}
+
+#if defined(__GLIBC__)
+// glibc's own entry points, so the interposed functions only count and forward
+extern "C"
+{
+	void* __libc_malloc(size_t);
+	void* __libc_calloc(size_t, size_t);
+	void* __libc_realloc(void*, size_t);
+	void* __libc_memalign(size_t, size_t);
+
+	void* malloc(size_t size)
+	{
+		++alloc::count;
+		rtcheck::violation(rtcheck::Kind::Allocation);
+		return __libc_malloc(size);
+	}
+
+	void* calloc(size_t num, size_t size)
+	{
+		++alloc::count;
+		rtcheck::violation(rtcheck::Kind::Allocation);
+		return __libc_calloc(num, size);
+	}
+
+	void* realloc(void* ptr, size_t size)
+	{
+		++alloc::count;
+		rtcheck::violation(rtcheck::Kind::Allocation);
+		return __libc_realloc(ptr, size);
+	}
+
+	// aligned operator new goes through aligned_alloc
+	void* aligned_alloc(size_t alignment, size_t size)
+	{
+		++alloc::count;
+		rtcheck::violation(rtcheck::Kind::Allocation);
+		return __libc_memalign(alignment, size);
+	}
+
+	void* memalign(size_t alignment, size_t size)
+	{
+		++alloc::count;
+		rtcheck::violation(rtcheck::Kind::Allocation);
+		return __libc_memalign(alignment, size);
+	}
+
+	int posix_memalign(void** ptr, size_t alignment, size_t size)
+	{
+		if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+			return EINVAL;
+		++alloc::count;
+		rtcheck::violation(rtcheck::Kind::Allocation);
+		auto mem = __libc_memalign(alignment, size);
+		if (mem == nullptr)
+			return ENOMEM;
+		*ptr = mem;
+		return 0;
+	}
+}
+#else
+void* operator new(std::size_t size)
+{
+	++alloc::count;
+	rtcheck::violation(rtcheck::Kind::Allocation);
+	if (auto ptr = std::malloc(size == 0 ? 1 : size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+#include <JuceHeader.h>
+
+// counts the heap allocations of each thread, so benchmarks can report allocations per block.
+// on linux with glibc malloc, calloc, realloc and the aligned allocations are interposed, which covers operator new
+// and juce's HeapBlock. elsewhere only operator new is counted.
+namespace alloc
+{
+	// allocations of the calling thread since it started
+	juce::int64 getCount() noexcept;
+
+	// false if only operator new is counted
+	bool isCountingMalloc() noexcept;
+}
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "Benchmark.h"
+#include "Scenarios.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if JUCE_LINUX
+#include <unistd.h>
+#endif
+
+namespace bench
+{
+	using Clock = std::chrono::steady_clock;
+	using Events = scenario::Events;
+
+	static constexpr int SampleRates[] = { 44100, 48000, 96000 };
+	static constexpr int BlockSizes[] = { 32, 64, 128, 256, 512, 1024 };
+
+	struct Scenario
+	{
+		const char* name;
+		// events, sampleRate, numSamples
+		std::function<void(Events&, double, juce::int64)> generate;
+		// sweeps xen once per block, like host automation
+		bool sweep;
+	};
+
+	static std::vector<Scenario> getScenarios()
+	{
+		return
+		{
+			{ "idle", [](Events&, double, juce::int64) {}, false },
+			{ "chords", scenario::addChords, false },
+			{ "trills", scenario::addTrills, false },
+			// a held chord while xen moves every block
+			{ "sweep", [](Events& events, double, juce::int64)
+			{
+				scenario::addChord(events, 0, 48, true);
+			}, true }
+		};
+	}
+
+	struct Measurement
+	{
+		std::vector<double> blockNs;
+		double totalNs;
+		juce::int64 numSamples, numEvents;
+	};
+
+	// processor, sweep, events, sampleRate, blockSize, numSamples, measure
+	static void run(XenAudioProcessor& processor, bool sweep, const Events& events,
+		double sampleRate, int blockSize, juce::int64 numSamples, Measurement* measurement)
+	{
+		juce::AudioBuffer<float> buffer(2, blockSize);
+		juce::MidiBuffer midi;
+		midi.ensureSize(static_cast<size_t>(4096));
+		size_t next = 0;
+		for (juce::int64 pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+		{
+			midi.clear();
+			const auto numEvents = scenario::fillBlock(events, pos, blockSize, next, midi);
+			if (sweep)
+			{
+				const auto phase = static_cast<double>(pos) / sampleRate * math::Tau * .5;
+				scenario::setParameter(processor, "xen", static_cast<float>(12. + 7. * std::sin(phase)));
+			}
+
+			const auto start = Clock::now();
+			processor.processBlock(buffer, midi);
+			const auto ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+
+			if (measurement == nullptr)
+				continue;
+			measurement->blockNs.push_back(ns);
+			measurement->totalNs += ns;
+			measurement->numSamples += blockSize;
+			measurement->numEvents += numEvents;
+		}
+	}
+
+	double getPercentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0.;
+		const auto idx = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size()))) - 1;
+		return sorted[juce::jlimit(static_cast<size_t>(0), sorted.size() - 1, idx)];
+	}
+
+	juce::int64 getResidentBytes()
+	{
+#if JUCE_LINUX
+		long pages = 0, resident = 0;
+		if (auto file = std::fopen("/proc/self/statm", "r"))
+		{
+			const auto numRead = std::fscanf(file, "%ld %ld", &pages, &resident);
+			std::fclose(file);
+			if (numRead == 2)
+				return static_cast<juce::int64>(resident) * sysconf(_SC_PAGESIZE);
+		}
+#endif
+		return -1;
+	}
+
+	var getMachineInfo()
+	{
+		auto info = new juce::DynamicObject();
+		info->setProperty("cpu", juce::SystemStats::getCpuModel());
+		info->setProperty("numCpus", juce::SystemStats::getNumCpus());
+		info->setProperty("cpuMHz", juce::SystemStats::getCpuSpeedInMegahertz());
+		info->setProperty("os", juce::SystemStats::getOperatingSystemName());
+#if JUCE_DEBUG
+		info->setProperty("build", "debug");
+#else
+		info->setProperty("build", "release");
+#endif
+		return info;
+	}
+
+	var runProcessBlock(const Options& options)
+	{
+		// keeps the scale library loaded across the fresh processors of each configuration
+		juce::SharedResourcePointer<scala::Library> scaleLibrary;
+		const std::pair<const char*, xen::Mode> modes[] =
+		{
+			{ "MPE", xen::Mode::MPE },
+			{ "MTS-ESP", xen::Mode::MTSESP }
+		};
+
+		juce::Array<var> results;
+		for (const auto& entry : getScenarios())
+			for (const auto& mode : modes)
+				for (const auto sampleRate : SampleRates)
+				{
+					const auto sampleRateD = static_cast<double>(sampleRate);
+					const auto numWarmUp = static_cast<juce::int64>(options.warmUpSeconds * sampleRateD);
+					const auto numSamples = static_cast<juce::int64>(options.seconds * sampleRateD);
+					Events events;
+					entry.generate(events, sampleRateD, numSamples);
+
+					for (const auto blockSize : BlockSizes)
+					{
+						Measurement measurement{ {}, 0., 0, 0 };
+						for (auto r = 0; r < options.numRuns; ++r)
+						{
+							XenAudioProcessor processor;
+							scenario::setParameter(processor, "mode", static_cast<float>(static_cast<int>(mode.second)));
+							scenario::setParameter(processor, "xensnap", entry.sweep ? 0.f : 1.f);
+							processor.setRateAndBufferSizeDetails(sampleRateD, blockSize);
+							// measures full quality, the scheduler would step down in slow builds
+							processor.setNonRealtime(true);
+							processor.prepareToPlay(sampleRateD, blockSize);
+							Events warmUp;
+							entry.generate(warmUp, sampleRateD, numWarmUp);
+							run(processor, entry.sweep, warmUp, sampleRateD, blockSize, numWarmUp, nullptr);
+							run(processor, entry.sweep, events, sampleRateD, blockSize, numSamples, &measurement);
+							processor.releaseResources();
+						}
+
+						auto sorted = measurement.blockNs;
+						std::sort(sorted.begin(), sorted.end());
+						const auto seconds = measurement.totalNs * 1e-9;
+						auto result = new juce::DynamicObject();
+						result->setProperty("scenario", entry.name);
+						result->setProperty("mode", mode.first);
+						result->setProperty("sampleRate", sampleRate);
+						result->setProperty("blockSize", blockSize);
+						result->setProperty("nsPerSample", measurement.totalNs / static_cast<double>(juce::jmax(static_cast<juce::int64>(1), measurement.numSamples)));
+						result->setProperty("blockP50Ns", getPercentile(sorted, .5));
+						result->setProperty("blockP99Ns", getPercentile(sorted, .99));
+						result->setProperty("blockMaxNs", sorted.empty() ? 0. : sorted.back());
+						result->setProperty("eventsPerSecond", seconds > 0. ? static_cast<double>(measurement.numEvents) / seconds : 0.);
+						results.add(result);
+					}
+				}
+
+		auto report = new juce::DynamicObject();
+		report->setProperty("machine", getMachineInfo());
+		report->setProperty("secondsPerRun", options.seconds);
+		report->setProperty("numRuns", options.numRuns);
+		report->setProperty("results", results);
+		return report;
+	}
+
+	var runStartup(int numInstances)
+	{
+		std::vector<std::unique_ptr<XenAudioProcessor>> instances;
+		juce::Array<var> constructNs, prepareNs;
+		const auto residentBefore = getResidentBytes();
+		for (auto i = 0; i < numInstances; ++i)
+		{
+			auto start = Clock::now();
+			instances.push_back(std::make_unique<XenAudioProcessor>());
+			constructNs.add(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+			start = Clock::now();
+			instances.back()->prepareToPlay(48000., 512);
+			prepareNs.add(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+		}
+		const auto residentAfter = getResidentBytes();
+
+		// the binary state against the xml that sessions from before it stored
+		const auto getElapsedNs = [](Clock::time_point start)
+		{
+			return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+		};
+		juce::Array<var> saveBinaryNs, restoreBinaryNs, saveXmlNs, restoreXmlNs;
+		size_t binaryBytes = 0, xmlBytes = 0;
+		for (auto& instance : instances)
+		{
+			juce::MemoryBlock binary, xml;
+			auto start = Clock::now();
+			instance->getStateInformation(binary);
+			saveBinaryNs.add(getElapsedNs(start));
+			start = Clock::now();
+			if (auto xmlState = instance->apvts.copyState().createXml())
+				juce::AudioProcessor::copyXmlToBinary(*xmlState, xml);
+			saveXmlNs.add(getElapsedNs(start));
+			start = Clock::now();
+			instance->setStateInformation(binary.getData(), static_cast<int>(binary.getSize()));
+			restoreBinaryNs.add(getElapsedNs(start));
+			start = Clock::now();
+			instance->setStateInformation(xml.getData(), static_cast<int>(xml.getSize()));
+			restoreXmlNs.add(getElapsedNs(start));
+			binaryBytes = binary.getSize();
+			xmlBytes = xml.getSize();
+		}
+
+		auto report = new juce::DynamicObject();
+		report->setProperty("machine", getMachineInfo());
+		report->setProperty("numInstances", numInstances);
+		// the first instance also pays for what instances share
+		report->setProperty("constructNs", constructNs);
+		report->setProperty("prepareNs", prepareNs);
+		report->setProperty("residentBytesPerInstance", residentBefore < 0 || numInstances == 0 ? -1. :
+			static_cast<double>(residentAfter - residentBefore) / static_cast<double>(numInstances));
+		report->setProperty("saveBinaryNs", saveBinaryNs);
+		report->setProperty("restoreBinaryNs", restoreBinaryNs);
+		report->setProperty("saveXmlNs", saveXmlNs);
+		report->setProperty("restoreXmlNs", restoreXmlNs);
+		report->setProperty("binaryStateBytes", static_cast<juce::int64>(binaryBytes));
+		report->setProperty("xmlStateBytes", static_cast<juce::int64>(xmlBytes));
+		for (auto& instance : instances)
+			instance->releaseResources();
+		return report;
+	}
+}
\ No newline at end of file
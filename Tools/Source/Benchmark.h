@@ -0,0 +1,42 @@
+#pragma once
+#include <JuceHeader.h>
+#include <vector>
+
+namespace bench
+{
+	using var = juce::var;
+
+	struct Options
+	{
+		Options() :
+			seconds(4.),
+			warmUpSeconds(.5),
+			numRuns(3)
+		{}
+
+		// seconds of audio measured per run, after warmUpSeconds
+		double seconds, warmUpSeconds;
+		// runs per configuration, their block times are pooled
+		int numRuns;
+	};
+
+	// cpu, cores, os and build type, so that reports from different machines aren't mixed up
+	var getMachineInfo();
+
+	// sorted, p [0, 1]
+	// nearest rank, so p99 of 100 values is the 99th. 0 if empty
+	double getPercentile(const std::vector<double>&, double);
+
+	// resident memory of the process, -1 where it can't be measured (only linux)
+	juce::int64 getResidentBytes();
+
+	// drives processBlock without a host through every scenario, mode,
+	// sample rate and block size. the input is generated deterministically,
+	// so reports are comparable between commits on the same machine
+	var runProcessBlock(const Options&);
+
+	// numInstances
+	// construction and prepareToPlay time, resident memory, and the time to save and restore
+	// the binary state and the xml state of older sessions, per instance
+	var runStartup(int);
+}
\ No newline at end of file
@@ -0,0 +1,371 @@
+#include "LoadTest.h"
+#include "Benchmark.h"
+#include "Scenarios.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if JUCE_LINUX || JUCE_MAC
+#include <sys/resource.h>
+#endif
+
+namespace load
+{
+	using Clock = std::chrono::steady_clock;
+	using Events = scenario::Events;
+
+	static constexpr int WatchedNote = 70;
+	static constexpr double PropagationTimeoutSeconds = 1.;
+	// the watcher sleeps this long between looks, which bounds the latency's resolution
+	static constexpr int WatchIntervalUs = 100;
+	// like the plugin's timer at 4 hz
+	static constexpr juce::int64 TimerIntervalNs = 250000000;
+	// the master's tuning alternates between these
+	static constexpr float TuningA = 12.f;
+	static constexpr float TuningB = 19.f;
+
+	static juce::int64 nowNs()
+	{
+		return static_cast<juce::int64>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+	}
+
+	// user and system time of the whole process, -1 where unknown
+	static double getCpuSeconds()
+	{
+#if JUCE_LINUX || JUCE_MAC
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return -1.;
+		const auto toSeconds = [](const timeval& t)
+		{
+			return static_cast<double>(t.tv_sec) + static_cast<double>(t.tv_usec) * 1e-6;
+		};
+		return toSeconds(usage.ru_utime) + toSeconds(usage.ru_stime);
+#else
+		return -1.;
+#endif
+	}
+
+	struct Instance
+	{
+		std::unique_ptr<XenAudioProcessor> processor;
+		juce::AudioBuffer<float> buffer;
+		juce::MidiBuffer midi;
+		size_t next;
+		double totalNs, maxNs;
+	};
+
+	// renders every instance once per cycle on worker threads, like a daw's audio threads
+	class Pool
+	{
+	public:
+		// numThreads, instances, events, blockSize
+		Pool(int numThreads, std::vector<Instance>& _instances, const Events& _events, int _blockSize) :
+			instances(_instances),
+			events(_events),
+			threads(),
+			mutex(),
+			started(),
+			finished(),
+			nextInstance(0),
+			numBusy(0),
+			cycle(0),
+			pos(0),
+			blockSize(_blockSize),
+			quit(false)
+		{
+			for (auto i = 0; i < numThreads; ++i)
+				threads.emplace_back([this]() { work(); });
+		}
+
+		~Pool()
+		{
+			{
+				const std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+			}
+			started.notify_all();
+			for (auto& thread : threads)
+				thread.join();
+		}
+
+		// renders the block at _pos of every instance, returns when all are done
+		void render(juce::int64 _pos)
+		{
+			{
+				const std::lock_guard<std::mutex> lock(mutex);
+				pos = _pos;
+				nextInstance.store(0);
+				numBusy = static_cast<int>(threads.size());
+				++cycle;
+			}
+			started.notify_all();
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [this]() { return numBusy == 0; });
+		}
+
+	private:
+		std::vector<Instance>& instances;
+		const Events& events;
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable started, finished;
+		std::atomic<int> nextInstance;
+		int numBusy;
+		juce::int64 cycle, pos;
+		int blockSize;
+		bool quit;
+
+		void work()
+		{
+			juce::int64 lastCycle = 0;
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					started.wait(lock, [&]() { return quit || cycle != lastCycle; });
+					if (quit)
+						return;
+					lastCycle = cycle;
+				}
+				const auto numInstances = static_cast<int>(instances.size());
+				for (auto i = nextInstance.fetch_add(1); i < numInstances; i = nextInstance.fetch_add(1))
+					process(instances[i]);
+				{
+					const std::lock_guard<std::mutex> lock(mutex);
+					if (--numBusy == 0)
+						finished.notify_one();
+				}
+			}
+		}
+
+		void process(Instance& instance)
+		{
+			instance.midi.clear();
+			scenario::fillBlock(events, pos, blockSize, instance.next, instance.midi);
+			instance.buffer.clear();
+			const auto start = Clock::now();
+			instance.processor->processBlock(instance.buffer, instance.midi);
+			const auto ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+			instance.totalNs += ns;
+			instance.maxNs = juce::jmax(instance.maxNs, ns);
+		}
+	};
+
+	// an mts-esp client on its own thread, timing how long tuning changes take to arrive
+	class Watcher
+	{
+	public:
+		Watcher() :
+			expectedFreq(0.),
+			changedNs(0),
+			pending(false),
+			quit(false),
+			latenciesNs(),
+			numMissed(0),
+			thread([this]() { watch(); })
+		{}
+
+		~Watcher()
+		{
+			stop();
+		}
+
+		void stop()
+		{
+			quit.store(true);
+			if (thread.joinable())
+				thread.join();
+		}
+
+		bool isPending() const noexcept
+		{
+			return pending.load();
+		}
+
+		// freq, ns
+		void expect(double freq, juce::int64 ns) noexcept
+		{
+			expectedFreq.store(freq);
+			changedNs.store(ns);
+			pending.store(true);
+		}
+
+		// only after stop
+		const std::vector<double>& getLatenciesNs() const noexcept
+		{
+			return latenciesNs;
+		}
+
+		int getNumMissed() const noexcept
+		{
+			return numMissed;
+		}
+
+	private:
+		std::atomic<double> expectedFreq;
+		std::atomic<juce::int64> changedNs;
+		std::atomic<bool> pending, quit;
+		std::vector<double> latenciesNs;
+		int numMissed;
+		std::thread thread;
+
+		void watch()
+		{
+			// without libMTS, this is the tuning bus stand-in on linux
+			auto client = MTS_RegisterClient();
+			while (!quit.load())
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(WatchIntervalUs));
+				if (!pending.load())
+					continue;
+				const auto expected = expectedFreq.load();
+				const auto freq = MTS_NoteToFrequency(client, static_cast<char>(WatchedNote), static_cast<char>(-1));
+				const auto elapsedNs = nowNs() - changedNs.load();
+				if (std::abs(freq - expected) <= expected * 1e-9)
+				{
+					latenciesNs.push_back(static_cast<double>(elapsedNs));
+					pending.store(false);
+				}
+				else if (static_cast<double>(elapsedNs) * 1e-9 > PropagationTimeoutSeconds)
+				{
+					++numMissed;
+					pending.store(false);
+				}
+			}
+			MTS_DeregisterClient(client);
+		}
+	};
+
+	juce::var run(const Options& options)
+	{
+		const auto numSamples = static_cast<juce::int64>(options.seconds * options.sampleRate);
+		Events events;
+		scenario::addChords(events, options.sampleRate, numSamples);
+
+		// instances are set up one by one, like a session loading
+		std::vector<Instance> instances(static_cast<size_t>(juce::jmax(1, options.numInstances)));
+		juce::Array<juce::var> residentBytes;
+		auto resident = bench::getResidentBytes();
+		for (size_t i = 0; i < instances.size(); ++i)
+		{
+			auto& instance = instances[i];
+			instance.processor = std::make_unique<XenAudioProcessor>();
+			const auto isMTS = static_cast<int>(i) < options.numMTSInstances;
+			const auto mode = isMTS ? xen::Mode::MTSESP : xen::Mode::MPE;
+			scenario::setParameter(*instance.processor, "mode", static_cast<float>(static_cast<int>(mode)));
+			instance.processor->setRateAndBufferSizeDetails(options.sampleRate, options.blockSize);
+			instance.processor->setNonRealtime(!options.realtime);
+			instance.processor->prepareToPlay(options.sampleRate, options.blockSize);
+			instance.buffer.setSize(2, options.blockSize);
+			instance.midi.ensureSize(4096);
+			instance.next = 0;
+			instance.totalNs = instance.maxNs = 0.;
+			const auto residentNow = bench::getResidentBytes();
+			residentBytes.add(resident < 0 ? -1. : static_cast<double>(residentNow - resident));
+			resident = residentNow;
+		}
+
+		auto& master = *instances.front().processor;
+		std::unique_ptr<Watcher> watcher;
+		if (options.numMTSInstances > 0)
+			watcher = std::make_unique<Watcher>();
+
+		const auto changeInterval = juce::jmax(static_cast<juce::int64>(options.blockSize),
+			static_cast<juce::int64>(options.tuningChangeSeconds * options.sampleRate));
+		auto tuning = TuningA;
+		std::vector<double> cycleNs;
+		const auto cpuBefore = getCpuSeconds();
+		const auto wallStart = Clock::now();
+		{
+			Pool pool(juce::jmax(1, options.numThreads), instances, events, options.blockSize);
+			auto lastTimerNs = nowNs();
+			for (juce::int64 pos = 0; pos + options.blockSize <= numSamples; pos += options.blockSize)
+			{
+				// no message loop runs the timers here, so the master beats for the tuning bus in between
+				if (nowNs() - lastTimerNs > TimerIntervalNs)
+				{
+					master.timerCallback();
+					lastTimerNs = nowNs();
+				}
+				// an automation point on the master, between two blocks like a host applies it
+				if (watcher != nullptr && pos % changeInterval < options.blockSize && !watcher->isPending())
+				{
+					tuning = tuning == TuningA ? TuningB : TuningA;
+					scenario::setParameter(master, "xen", tuning);
+					watcher->expect(math::noteToFreq(static_cast<double>(WatchedNote), static_cast<double>(tuning)), nowNs());
+				}
+				const auto start = Clock::now();
+				pool.render(pos);
+				cycleNs.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+			}
+		}
+		const auto wallSeconds = std::chrono::duration<double>(Clock::now() - wallStart).count();
+		const auto cpuAfter = getCpuSeconds();
+		if (watcher != nullptr)
+			watcher->stop();
+
+		const auto budgetNs = static_cast<double>(options.blockSize) / options.sampleRate * 1e9;
+		const auto audioSeconds = static_cast<double>(cycleNs.size() * static_cast<size_t>(options.blockSize)) / options.sampleRate;
+		auto sorted = cycleNs;
+		std::sort(sorted.begin(), sorted.end());
+		const auto numOverruns = std::count_if(sorted.begin(), sorted.end(), [budgetNs](double ns) { return ns > budgetNs; });
+
+		juce::Array<juce::var> perInstance;
+		const auto numBlocks = static_cast<double>(juce::jmax(static_cast<size_t>(1), cycleNs.size()));
+		for (size_t i = 0; i < instances.size(); ++i)
+		{
+			auto result = new juce::DynamicObject();
+			result->setProperty("mode", static_cast<int>(i) < options.numMTSInstances ? "MTS-ESP" : "MPE");
+			result->setProperty("meanBlockNs", instances[i].totalNs / numBlocks);
+			result->setProperty("maxBlockNs", instances[i].maxNs);
+			result->setProperty("residentBytes", residentBytes[static_cast<int>(i)]);
+			// where the adaptive quality ended up, and how often it had to step down
+			const auto snapshot = instances[i].processor->statistics.snapshot();
+			result->setProperty("qualityTier", quality::getName(snapshot.qualityTier));
+			result->setProperty("qualityStepDowns", static_cast<juce::int64>(snapshot[stats::Counter::QualityStepDowns]));
+			perInstance.add(result);
+		}
+
+		auto report = new juce::DynamicObject();
+		report->setProperty("machine", bench::getMachineInfo());
+		report->setProperty("numInstances", static_cast<int>(instances.size()));
+		report->setProperty("numMTSInstances", options.numMTSInstances);
+		report->setProperty("numThreads", options.numThreads);
+		report->setProperty("sampleRate", options.sampleRate);
+		report->setProperty("blockSize", options.blockSize);
+		report->setProperty("realtime", options.realtime);
+		// how many times faster than real time the whole session rendered
+		report->setProperty("realtimeFactor", wallSeconds > 0. ? audioSeconds / wallSeconds : 0.);
+		// cores kept busy if the session ran in real time, -1 if unknown
+		report->setProperty("cpuCoresAtRealtime", cpuBefore < 0. || audioSeconds <= 0. ? -1. : (cpuAfter - cpuBefore) / audioSeconds);
+		report->setProperty("cycleBudgetNs", budgetNs);
+		report->setProperty("cycleP50Ns", bench::getPercentile(sorted, .5));
+		report->setProperty("cycleP99Ns", bench::getPercentile(sorted, .99));
+		report->setProperty("cycleMaxNs", sorted.empty() ? 0. : sorted.back());
+		report->setProperty("cycleOverruns", static_cast<int>(numOverruns));
+		report->setProperty("instances", perInstance);
+
+		// from setting the master's parameter until a client reads the new tuning,
+		// including the wait for the master's next block
+		if (watcher != nullptr)
+		{
+			auto latencies = watcher->getLatenciesNs();
+			std::sort(latencies.begin(), latencies.end());
+			auto propagation = new juce::DynamicObject();
+			propagation->setProperty("numChanges", static_cast<int>(latencies.size()) + watcher->getNumMissed());
+			propagation->setProperty("numMissed", watcher->getNumMissed());
+			propagation->setProperty("p50Ns", bench::getPercentile(latencies, .5));
+			propagation->setProperty("p99Ns", bench::getPercentile(latencies, .99));
+			propagation->setProperty("maxNs", latencies.empty() ? 0. : latencies.back());
+			report->setProperty("tuningPropagation", propagation);
+		}
+		return report;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+#include <JuceHeader.h>
+
+// many instances in one process, rendered like a daw renders a session
+namespace load
+{
+	struct Options
+	{
+		Options() :
+			numInstances(50),
+			numMTSInstances(1),
+			numThreads(juce::SystemStats::getNumCpus()),
+			seconds(10.),
+			sampleRate(48000.),
+			blockSize(256),
+			tuningChangeSeconds(.25),
+			realtime(false)
+		{}
+
+		// the first numMTSInstances run in mts-esp mode, the first of them is master.
+		// the others run in mpe mode
+		int numInstances, numMTSInstances, numThreads;
+		// seconds of audio rendered
+		double seconds, sampleRate;
+		int blockSize;
+		// how often the master's tuning changes while a client watches for it
+		double tuningChangeSeconds;
+		// lets the synth's quality step down under load like in a live session.
+		// off by default, so every run measures the same work, like an offline render
+		bool realtime;
+	};
+
+	// renders all instances block by block on a thread pool, as fast as possible.
+	// reports memory per instance, cpu time against the real-time budget and how long
+	// a tuning change of the master takes until an mts-esp client sees it
+	juce::var run(const Options&);
+}
\ No newline at end of file
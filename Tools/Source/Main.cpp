@@ -0,0 +1,232 @@
+#include <JuceHeader.h>
+#include <iostream>
+#include "Benchmark.h"
+#include "LoadTest.h"
+#include "MidiBench.h"
+#include "RealtimeCheck.h"
+#include "Render.h"
+#include "Retune.h"
+#include "SimdCheck.h"
+#include "../../Source/TuningBus.h"
+
+// writes a report to --out, or to stdout without it
+static void writeReport(const juce::ArgumentList& args, const juce::var& report)
+{
+	const auto json = juce::JSON::toString(report);
+	if (!args.containsOption("--out"))
+	{
+		std::cout << json << std::endl;
+		return;
+	}
+	const auto file = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--out"));
+	if (!file.replaceWithText(json))
+		juce::ConsoleApplication::fail("could not write " + file.getFullPathName());
+}
+
+int main(int argc, char* argv[])
+{
+	const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+	// results must not depend on plugins or other tools running on the machine
+	xen::TuningBus::usePrivateBus();
+	juce::ConsoleApplication app;
+	app.addHelpCommand("--help|-h", "Xen tools", true);
+
+	app.addCommand({ "bench",
+		"bench [--seconds=4] [--runs=3] [--out=report.json]",
+		"Times processBlock over all scenarios, modes, sample rates and block sizes",
+		"Prints ns/sample, p50/p99/max block time and events/s per configuration as JSON.",
+		[](const juce::ArgumentList& args)
+		{
+			bench::Options options;
+			if (args.containsOption("--seconds"))
+				options.seconds = args.getValueForOption("--seconds").getDoubleValue();
+			if (args.containsOption("--runs"))
+				options.numRuns = juce::jmax(1, args.getValueForOption("--runs").getIntValue());
+			writeReport(args, bench::runProcessBlock(options));
+		} });
+
+	app.addCommand({ "midibench",
+		"midibench [--blocks=200] [--runs=3] [--out=report.json]",
+		"Times the MIDI stages on their own and as a chain under extreme event density",
+		"Auto MPE, MPE split and rescaler at 10, 1k and 50k events per block, with and without "
+		"voice stealing. Prints ns/event, p50/p99/max block time and allocations per block as JSON.",
+		[](const juce::ArgumentList& args)
+		{
+			bench::MidiOptions options;
+			if (args.containsOption("--blocks"))
+				options.numBlocks = juce::jmax(1, args.getValueForOption("--blocks").getIntValue());
+			if (args.containsOption("--runs"))
+				options.numRuns = juce::jmax(1, args.getValueForOption("--runs").getIntValue());
+			writeReport(args, bench::runMidiPipeline(options));
+		} });
+
+	app.addCommand({ "simdcheck",
+		"simdcheck [--runs=10] [--out=report.json]",
+		"Checks the vectorised kernels of every supported instruction set against the scalar path",
+		"Oscillator and tuning table kernels for sse2, avx2 and avx512, whichever the cpu supports. "
+		"Prints the largest deviation, ns per value and speedup over the scalar path of each path as JSON and exits with 1 if one is out of tolerance.",
+		[](const juce::ArgumentList& args)
+		{
+			const auto numRuns = args.containsOption("--runs") ?
+				juce::jmax(1, args.getValueForOption("--runs").getIntValue()) : 10;
+			const auto report = simdcheck::run(numRuns);
+			writeReport(args, report);
+			if (!static_cast<bool>(report["passed"]))
+				juce::ConsoleApplication::fail("kernels differ from the scalar path", 1);
+		} });
+
+	app.addCommand({ "startup",
+		"startup [--instances=100] [--out=report.json]",
+		"Times construction, prepareToPlay and saving and restoring the state, and measures resident memory per instance",
+		"Resident memory is only measured on Linux.",
+		[](const juce::ArgumentList& args)
+		{
+			const auto numInstances = args.containsOption("--instances") ?
+				juce::jmax(1, args.getValueForOption("--instances").getIntValue()) : 100;
+			writeReport(args, bench::runStartup(numInstances));
+		} });
+
+#if XEN_RT_CHECK
+	app.addCommand({ "rtcheck",
+		"rtcheck [--seconds=1]",
+		"Runs the benchmark scenarios and fails on allocations or locks in processBlock",
+		"Only in builds with XEN_RT_CHECK=1 (the Linux debug configuration). "
+		"Prints every distinct call stack that allocated or locked a mutex and exits with 1 if there was any.",
+		[](const juce::ArgumentList& args)
+		{
+			if (!rtcheck::isSupported())
+				juce::ConsoleApplication::fail("real-time checks need linux with glibc");
+			bench::Options options;
+			options.seconds = args.containsOption("--seconds") ?
+				args.getValueForOption("--seconds").getDoubleValue() : 1.;
+			// the first blocks have to be real-time safe too
+			options.warmUpSeconds = 0.;
+			options.numRuns = 1;
+			bench::runProcessBlock(options);
+			if (rtcheck::getNumViolations() == 0)
+			{
+				std::cout << "no real-time violations" << std::endl;
+				return;
+			}
+			std::cout << rtcheck::getReport().joinIntoString("\n") << std::endl;
+			juce::ConsoleApplication::fail(juce::String(rtcheck::getNumViolations()) + " real-time violations in processBlock", 1);
+		} });
+#endif
+
+	app.addCommand({ "loadtest",
+		"loadtest [--instances=50] [--mts=1] [--threads=n] [--seconds=10] [--block=256] [--realtime] [--out=report.json]",
+		"Renders many instances in one process on a thread pool, like a large session",
+		"The first --mts instances run in MTS-ESP mode and the first of them is master. The rest run in MPE mode. "
+		"Reports memory per instance, CPU against the real-time budget and how long the master's tuning changes "
+		"take to reach an MTS-ESP client. Without libMTS the client reads the tuning bus (Linux). "
+		"Instances render at full quality like offline, --realtime lets the synth step down under load.",
+		[](const juce::ArgumentList& args)
+		{
+			load::Options options;
+			if (args.containsOption("--instances"))
+				options.numInstances = juce::jmax(1, args.getValueForOption("--instances").getIntValue());
+			if (args.containsOption("--mts"))
+				options.numMTSInstances = juce::jmax(0, args.getValueForOption("--mts").getIntValue());
+			if (args.containsOption("--threads"))
+				options.numThreads = juce::jmax(1, args.getValueForOption("--threads").getIntValue());
+			if (args.containsOption("--seconds"))
+				options.seconds = args.getValueForOption("--seconds").getDoubleValue();
+			if (args.containsOption("--block"))
+				options.blockSize = juce::jlimit(16, 4096, args.getValueForOption("--block").getIntValue());
+			options.realtime = args.containsOption("--realtime");
+			writeReport(args, load::run(options));
+		} });
+
+	app.addCommand({ "render",
+		"render --dir=golden",
+		"Renders the regression scenarios into a directory",
+		"Writes audio, midi output and, in MTS-ESP mode, the tuning clients see. "
+		"Render a reference before a refactor, then compare against it.",
+		[](const juce::ArgumentList& args)
+		{
+			const auto dir = args.getFileForOption("--dir");
+			if (!render::renderAll(dir))
+				juce::ConsoleApplication::fail("could not render into " + dir.getFullPathName());
+		} });
+
+	app.addCommand({ "compare",
+		"compare --reference=golden [--actual=dir] [--db=-80] [--cents=0.01]",
+		"Compares renders against a reference, rendering them first without --actual",
+		"MIDI output has to match exactly, audio and MTS-ESP tuning within the tolerances. "
+		"Exits with 1 if anything differs.",
+		[](const juce::ArgumentList& args)
+		{
+			render::Tolerances tolerances;
+			if (args.containsOption("--db"))
+				tolerances.maxDiffDb = args.getValueForOption("--db").getDoubleValue();
+			if (args.containsOption("--cents"))
+				tolerances.maxCents = args.getValueForOption("--cents").getDoubleValue();
+			const auto reference = args.getExistingFolderForOption("--reference");
+			std::unique_ptr<juce::TemporaryFile> rendered;
+			auto actual = juce::File();
+			if (args.containsOption("--actual"))
+				actual = args.getExistingFolderForOption("--actual");
+			else
+			{
+				rendered = std::make_unique<juce::TemporaryFile>();
+				actual = rendered->getFile();
+				if (!render::renderAll(actual))
+					juce::ConsoleApplication::fail("could not render into " + actual.getFullPathName());
+			}
+			juce::StringArray report;
+			const auto isOk = render::compare(reference, actual, tolerances, report);
+			if (rendered != nullptr)
+				actual.deleteRecursively();
+			std::cout << report.joinIntoString("\n") << std::endl;
+			if (!isOk)
+				juce::ConsoleApplication::fail("renders differ from the reference", 1);
+		} });
+
+	app.addCommand({ "retune",
+		"retune --in=dir --out=dir [--mode=mpe|sysex] [--xen=12] [--anchor=440] [--pbrange=48] [--steps-in-12] [--scale=file.scl] [--threads=n]",
+		"Retunes every MIDI file below a directory, in parallel",
+		"Runs the plugin's MIDI processing over each file. MPE spreads the notes over channels 2-16 with pitch bends. "
+		"SysEx puts an MTS bulk dump in front of the unchanged notes. All tracks are merged into one.",
+		[](const juce::ArgumentList& args)
+		{
+			const auto inDir = args.getExistingFolderForOption("--in");
+			const auto outDir = args.getFileForOption("--out");
+			if (outDir == inDir || outDir.isAChildOf(inDir))
+				juce::ConsoleApplication::fail("--out must not be inside --in");
+			retune::Settings settings;
+			if (args.containsOption("--mode"))
+			{
+				const auto mode = args.getValueForOption("--mode").toLowerCase();
+				if (mode != "mpe" && mode != "sysex")
+					juce::ConsoleApplication::fail("--mode is mpe or sysex");
+				settings.mode = mode == "sysex" ? xen::Mode::SysEx : xen::Mode::MPE;
+			}
+			if (args.containsOption("--xen"))
+				settings.xen = juce::jlimit(static_cast<double>(axiom::MinXen), static_cast<double>(axiom::MaxXen),
+					args.getValueForOption("--xen").getDoubleValue());
+			if (args.containsOption("--anchor"))
+				settings.anchorFreq = args.getValueForOption("--anchor").getDoubleValue();
+			if (args.containsOption("--pbrange"))
+				settings.pbRange = juce::jlimit(1., 48., args.getValueForOption("--pbrange").getDoubleValue());
+			settings.stepsIn12 = args.containsOption("--steps-in-12");
+			if (args.containsOption("--scale"))
+			{
+				const auto scaleFile = args.getExistingFileForOption("--scale");
+				if (!scala::parse(settings.scale, scaleFile))
+					juce::ConsoleApplication::fail("could not read the scale " + scaleFile.getFullPathName());
+				settings.hasScale = true;
+			}
+			if (args.containsOption("--threads"))
+				settings.numThreads = juce::jmax(1, args.getValueForOption("--threads").getIntValue());
+
+			const auto result = retune::retuneAll(inDir, outDir, settings);
+			std::cout << result.numFiles - result.numFailed << " of " << result.numFiles << " files retuned in "
+				<< juce::String(result.seconds, 2) << " s" << std::endl;
+			if (!result.errors.isEmpty())
+				std::cout << result.errors.joinIntoString("\n") << std::endl;
+			if (result.numFailed != 0)
+				juce::ConsoleApplication::fail(juce::String(result.numFailed) + " files failed", 1);
+		} });
+
+	return app.findAndRunCommand(argc, argv);
+}
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "MidiBench.h"
+#include "Allocations.h"
+#include "Benchmark.h"
+#include "../../Source/AutoMPE.h"
+#include "../../Source/Xen.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace bench
+{
+	using Clock = std::chrono::steady_clock;
+	using MidiBuffer = juce::MidiBuffer;
+	using MidiMessage = juce::MidiMessage;
+
+	static constexpr int BlockSize = 512;
+	static constexpr int NumWarmUpBlocks = 8;
+	static constexpr int EventsPerBlock[] = { 10, 1000, 50000 };
+	static constexpr double PBRange = 48.;
+	// held notes: auto mpe has 15 voices, so only the stealing input runs out of them
+	static constexpr int MaxHeldNoSteal = 8;
+	static constexpr int MaxHeldSteal = 32;
+	static constexpr int SysexInterval = 64;
+
+	enum class Stage { AutoMPE, Split, Rescale, Chain, NumStages };
+
+	static const char* getName(Stage stage) noexcept
+	{
+		static constexpr const char* Names[] = { "auto mpe", "split", "rescale", "chain" };
+		return Names[static_cast<int>(stage)];
+	}
+
+	// deterministic input on channel 1, like a keyboard or arpeggiator in front of xen:
+	// notes, per-note controllers (bend, pressure, cc74) and a sysex message now and then
+	class Generator
+	{
+	public:
+		Generator(bool _steal) :
+			random(1234),
+			held(),
+			numGenerated(0),
+			steal(_steal)
+		{
+			held.reserve(MaxHeldSteal);
+		}
+
+		// midi, numEvents
+		void fill(MidiBuffer& midi, int numEvents)
+		{
+			midi.clear();
+			const juce::uint8 sysex[] = { 0x7e, 0x7f, 0x06, 0x01 };
+			for (auto i = 0; i < numEvents; ++i)
+			{
+				const auto ts = static_cast<int>(static_cast<juce::int64>(i) * BlockSize / numEvents);
+				if (++numGenerated % SysexInterval == 0)
+				{
+					midi.addEvent(MidiMessage::createSysExMessage(sysex, static_cast<int>(sizeof(sysex))), ts);
+					continue;
+				}
+				const auto maxHeld = steal ? MaxHeldSteal : MaxHeldNoSteal;
+				const auto r = random.nextInt(10);
+				if (held.empty() || (r < 4 && static_cast<int>(held.size()) < maxHeld))
+					midi.addEvent(MidiMessage::noteOn(1, noteOn(), static_cast<juce::uint8>(100)), ts);
+				else if (r < 6 || static_cast<int>(held.size()) >= maxHeld)
+				{
+					midi.addEvent(MidiMessage::noteOff(1, held.front()), ts);
+					held.erase(held.begin());
+				}
+				else if (r < 8)
+					midi.addEvent(MidiMessage::pitchWheel(1, random.nextInt(16384)), ts);
+				else if (r < 9)
+					midi.addEvent(MidiMessage::channelPressureChange(1, random.nextInt(128)), ts);
+				else
+					midi.addEvent(MidiMessage::controllerEvent(1, 74, random.nextInt(128)), ts);
+			}
+		}
+
+	private:
+		juce::Random random;
+		std::vector<int> held;
+		juce::int64 numGenerated;
+		bool steal;
+
+		int noteOn()
+		{
+			auto note = 36 + random.nextInt(60);
+			while (std::find(held.begin(), held.end(), note) != held.end())
+				note = 36 + (note - 36 + 1) % 60;
+			held.push_back(note);
+			return note;
+		}
+	};
+
+	struct StageMeasurement
+	{
+		std::vector<double> blockNs;
+		juce::int64 numEvents, numAllocations, maxAllocations;
+	};
+
+	// stage, numEvents, steal, numBlocks, measurement
+	static void runStage(Stage stage, int numEvents, bool steal, int numBlocks, StageMeasurement& measurement)
+	{
+		// set up like xen prepares them
+		mpe::AutoMPE autoMPE;
+		mpe::Split split;
+		split.prepare(xen::Xen::MidiBufferBytes);
+		xen::XenRescalerMPE rescaler(split);
+		rescaler.prepare(xen::Xen::MidiBufferBytes * mpe::NumChannelsMPE);
+		rescaler.update(PBRange);
+		double freqTable[xen::Xen::NumPitches];
+		for (auto i = 0; i < xen::Xen::NumPitches; ++i)
+			freqTable[i] = math::noteToFreq(static_cast<double>(i));
+
+		Generator generator(steal);
+		MidiBuffer midi;
+		for (auto b = 0; b < NumWarmUpBlocks + numBlocks; ++b)
+		{
+			generator.fill(midi, numEvents);
+			const auto isMeasured = b >= NumWarmUpBlocks;
+			auto ns = 0.;
+			juce::int64 numAllocations = 0;
+			// runs every stage, but only measures the ones that belong to this measurement
+			const auto process = [&](Stage s, const auto& func)
+			{
+				const auto isTimed = stage == s || stage == Stage::Chain;
+				const auto allocationsBefore = alloc::getCount();
+				const auto start = Clock::now();
+				func();
+				const auto end = Clock::now();
+				if (!isTimed)
+					return;
+				ns += static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+				numAllocations += alloc::getCount() - allocationsBefore;
+			};
+			process(Stage::AutoMPE, [&]() { autoMPE(midi); });
+			process(Stage::Split, [&]() { split(midi); });
+			process(Stage::Rescale, [&]() { rescaler(midi, freqTable, BlockSize); });
+
+			if (!isMeasured)
+				continue;
+			measurement.blockNs.push_back(ns);
+			measurement.numEvents += numEvents;
+			measurement.numAllocations += numAllocations;
+			measurement.maxAllocations = juce::jmax(measurement.maxAllocations, numAllocations);
+		}
+	}
+
+	juce::var runMidiPipeline(const MidiOptions& options)
+	{
+		juce::Array<juce::var> results;
+		for (auto s = 0; s < static_cast<int>(Stage::NumStages); ++s)
+			for (const auto numEvents : EventsPerBlock)
+				for (const auto steal : { false, true })
+				{
+					const auto stage = static_cast<Stage>(s);
+					StageMeasurement measurement{ {}, 0, 0, 0 };
+					for (auto r = 0; r < options.numRuns; ++r)
+						runStage(stage, numEvents, steal, options.numBlocks, measurement);
+
+					auto sorted = measurement.blockNs;
+					std::sort(sorted.begin(), sorted.end());
+					auto totalNs = 0.;
+					for (const auto ns : sorted)
+						totalNs += ns;
+					const auto numBlocks = static_cast<double>(juce::jmax(static_cast<size_t>(1), sorted.size()));
+					auto result = new juce::DynamicObject();
+					result->setProperty("stage", getName(stage));
+					result->setProperty("eventsPerBlock", numEvents);
+					result->setProperty("voiceStealing", steal);
+					result->setProperty("nsPerEvent", totalNs / static_cast<double>(juce::jmax(static_cast<juce::int64>(1), measurement.numEvents)));
+					result->setProperty("blockP50Ns", getPercentile(sorted, .5));
+					result->setProperty("blockP99Ns", getPercentile(sorted, .99));
+					result->setProperty("blockMaxNs", sorted.empty() ? 0. : sorted.back());
+					result->setProperty("allocationsPerBlock", static_cast<double>(measurement.numAllocations) / numBlocks);
+					result->setProperty("maxAllocationsPerBlock", measurement.maxAllocations);
+					results.add(result);
+				}
+
+		auto report = new juce::DynamicObject();
+		report->setProperty("machine", getMachineInfo());
+		report->setProperty("blockSize", BlockSize);
+		report->setProperty("blocksPerRun", options.numBlocks);
+		report->setProperty("numRuns", options.numRuns);
+		// without it, allocations inside juce's HeapBlock (e.g. growing a MidiBuffer) are missed
+		report->setProperty("countsMalloc", alloc::isCountingMalloc());
+		report->setProperty("results", results);
+		return report;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+#include <JuceHeader.h>
+
+namespace bench
+{
+	struct MidiOptions
+	{
+		MidiOptions() :
+			numBlocks(200),
+			numRuns(3)
+		{}
+
+		// measured blocks per run, after a few warm-up blocks
+		int numBlocks;
+		// runs per configuration, their block times are pooled
+		int numRuns;
+	};
+
+	// times auto mpe, mpe split and the rescaler on their own and as a chain
+	// at 10, 1k and 50k events per block (notes, mpe controllers and sysex),
+	// with and without voice stealing. reports allocations per block
+	juce::var runMidiPipeline(const MidiOptions&);
+}
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "RealtimeCheck.h"
+
+#if XEN_RT_CHECK && defined(__GLIBC__)
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <vector>
+
+namespace rtcheck
+{
+	static constexpr int MaxViolations = 256;
+	static constexpr int MaxFrames = 32;
+	// violation and the hook itself
+	static constexpr int NumHookFrames = 2;
+
+	struct Violation
+	{
+		Kind kind;
+		int numFrames;
+		void* frames[MaxFrames];
+	};
+
+	// preallocated, recording must not allocate
+	static Violation violations[MaxViolations];
+	static std::atomic<int> numViolations(0);
+	// backtrace allocates and locks itself, which mustn't be reported again
+	static thread_local bool recording = false;
+
+	using MutexFn = int (*)(pthread_mutex_t*);
+	using RwlockFn = int (*)(pthread_rwlock_t*);
+	using SemFn = int (*)(sem_t*);
+
+	// glibc's functions behind the hooks
+	static std::atomic<MutexFn> realMutexLock(nullptr), realMutexTrylock(nullptr);
+	static std::atomic<RwlockFn> realRdlock(nullptr), realWrlock(nullptr), realTryrdlock(nullptr), realTrywrlock(nullptr);
+	static std::atomic<SemFn> realSemWait(nullptr);
+
+	// real, name
+	// found on first use, which is usually the warm up below
+	template<typename Fn>
+	static Fn findReal(std::atomic<Fn>& real, const char* name) noexcept
+	{
+		auto fn = real.load();
+		if (fn == nullptr)
+		{
+			fn = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+			real.store(fn);
+		}
+		return fn;
+	}
+
+	// backtrace loads the unwinder on its first call, which allocates,
+	// and so might looking up the real functions
+	static const int warmUp = []()
+	{
+		findReal(realMutexLock, "pthread_mutex_lock");
+		findReal(realMutexTrylock, "pthread_mutex_trylock");
+		findReal(realRdlock, "pthread_rwlock_rdlock");
+		findReal(realWrlock, "pthread_rwlock_wrlock");
+		findReal(realTryrdlock, "pthread_rwlock_tryrdlock");
+		findReal(realTrywrlock, "pthread_rwlock_trywrlock");
+		findReal(realSemWait, "sem_wait");
+		void* frames[1];
+		return backtrace(frames, 1);
+	}();
+
+	bool isSupported() noexcept
+	{
+		return true;
+	}
+
+	void violation(Kind kind) noexcept
+	{
+		if (recording || !rt::isRealtime())
+			return;
+		recording = true;
+		const auto idx = numViolations.fetch_add(1);
+		if (idx < MaxViolations)
+		{
+			auto& v = violations[idx];
+			v.kind = kind;
+			v.numFrames = backtrace(v.frames, MaxFrames);
+		}
+		recording = false;
+	}
+
+	int getNumViolations() noexcept
+	{
+		return numViolations.load();
+	}
+
+	// "binary(mangled+offset) [address]"
+	static juce::String demangle(const char* symbol)
+	{
+		const juce::String line(symbol);
+		const auto mangled = line.fromFirstOccurrenceOf("(", false, false).upToFirstOccurrenceOf("+", false, false);
+		if (mangled.isEmpty())
+			return line;
+		auto status = 0;
+		auto demangled = abi::__cxa_demangle(mangled.toRawUTF8(), nullptr, nullptr, &status);
+		if (status != 0 || demangled == nullptr)
+			return line;
+		const juce::String name(demangled);
+		std::free(demangled);
+		return name;
+	}
+
+	static bool isSameStack(const Violation& a, const Violation& b) noexcept
+	{
+		if (a.kind != b.kind || a.numFrames != b.numFrames)
+			return false;
+		for (auto i = 0; i < a.numFrames; ++i)
+			if (a.frames[i] != b.frames[i])
+				return false;
+		return true;
+	}
+
+	juce::StringArray getReport()
+	{
+		const auto numTotal = numViolations.load();
+		const auto numRecorded = juce::jmin(numTotal, MaxViolations);
+		// first index, count
+		std::vector<std::pair<int, int>> stacks;
+		for (auto i = 0; i < numRecorded; ++i)
+		{
+			auto it = std::find_if(stacks.begin(), stacks.end(), [i](const std::pair<int, int>& stack)
+			{
+				return isSameStack(violations[stack.first], violations[i]);
+			});
+			if (it != stacks.end())
+				++it->second;
+			else
+				stacks.push_back({ i, 1 });
+		}
+
+		juce::StringArray report;
+		for (const auto& stack : stacks)
+		{
+			const auto& v = violations[stack.first];
+			report.add(juce::String(v.kind == Kind::Allocation ? "allocation" : "lock") +
+				" in processBlock, " + juce::String(stack.second) + "x:");
+			auto symbols = backtrace_symbols(v.frames, v.numFrames);
+			for (auto i = NumHookFrames; i < v.numFrames; ++i)
+				report.add("    " + (symbols != nullptr ? demangle(symbols[i]) : juce::String::toHexString(reinterpret_cast<juce::pointer_sized_int>(v.frames[i]))));
+			std::free(symbols);
+		}
+		if (numTotal > numRecorded)
+			report.add(juce::String(numTotal - numRecorded) + " more violations weren't recorded");
+		return report;
+	}
+}
+
+// forward to glibc's. a try lock doesn't block, but it still means a lock the audio thread shares
+extern "C"
+{
+	int pthread_mutex_lock(pthread_mutex_t* mutex)
+	{
+		rtcheck::violation(rtcheck::Kind::Lock);
+		return rtcheck::findReal(rtcheck::realMutexLock, "pthread_mutex_lock")(mutex);
+	}
+
+	int pthread_mutex_trylock(pthread_mutex_t* mutex)
+	{
+		rtcheck::violation(rtcheck::Kind::Lock);
+		return rtcheck::findReal(rtcheck::realMutexTrylock, "pthread_mutex_trylock")(mutex);
+	}
+
+	int pthread_rwlock_rdlock(pthread_rwlock_t* lock)
+	{
+		rtcheck::violation(rtcheck::Kind::Lock);
+		return rtcheck::findReal(rtcheck::realRdlock, "pthread_rwlock_rdlock")(lock);
+	}
+
+	int pthread_rwlock_wrlock(pthread_rwlock_t* lock)
+	{
+		rtcheck::violation(rtcheck::Kind::Lock);
+		return rtcheck::findReal(rtcheck::realWrlock, "pthread_rwlock_wrlock")(lock);
+	}
+
+	int pthread_rwlock_tryrdlock(pthread_rwlock_t* lock)
+	{
+		rtcheck::violation(rtcheck::Kind::Lock);
+		return rtcheck::findReal(rtcheck::realTryrdlock, "pthread_rwlock_tryrdlock")(lock);
+	}
+
+	int pthread_rwlock_trywrlock(pthread_rwlock_t* lock)
+	{
+		rtcheck::violation(rtcheck::Kind::Lock);
+		return rtcheck::findReal(rtcheck::realTrywrlock, "pthread_rwlock_trywrlock")(lock);
+	}
+
+	int sem_wait(sem_t* sem)
+	{
+		rtcheck::violation(rtcheck::Kind::Lock);
+		return rtcheck::findReal(rtcheck::realSemWait, "sem_wait")(sem);
+	}
+}
+#else
+namespace rtcheck
+{
+	bool isSupported() noexcept
+	{
+		return false;
+	}
+
+	void violation(Kind) noexcept
+	{
+	}
+
+	int getNumViolations() noexcept
+	{
+		return 0;
+	}
+
+	juce::StringArray getReport()
+	{
+		return {};
+	}
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../../Source/Realtime.h"
+
+// catches allocations and locks inside realtime scopes (processBlock) of builds
+// with XEN_RT_CHECK=1. malloc and the aligned allocations are interposed by
+// Allocations.cpp, the mutex, rwlock and semaphore waits here.
+// only implemented for linux with glibc
+namespace rtcheck
+{
+	enum class Kind { Allocation, Lock };
+
+	bool isSupported() noexcept;
+
+	// called by the hooks, records the call stack if the thread is in a realtime scope
+	void violation(Kind) noexcept;
+
+	int getNumViolations() noexcept;
+
+	// one entry per distinct call stack with how often it was hit, symbolised
+	juce::StringArray getReport();
+}
\ No newline at end of file
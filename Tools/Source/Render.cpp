@@ -0,0 +1,286 @@
+#include "Render.h"
+#include "Scenarios.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace render
+{
+	using Events = scenario::Events;
+	using String = juce::String;
+
+	static constexpr int AudioMagic = 0x55415258; // XRAU
+	static constexpr double SampleRate = 48000.;
+	static constexpr double Seconds = 2.;
+	// odd sizes on purpose, output must not depend on where blocks start
+	static constexpr int BlockSizes[] = { 256, 100, 17, 512 };
+	static constexpr int NumPitches = 128;
+	// samples between the change points of the sub-block sweep
+	static constexpr int ChangePointInterval = 32;
+
+	struct Scenario
+	{
+		const char* name;
+		xen::Mode mode;
+		float xen;
+		bool lfo;
+		// events, sampleRate, numSamples
+		void (*generate)(Events&, double, juce::int64);
+		// sweeps xen once per block, like host automation
+		bool sweep;
+		// sweeps xen every ChangePointInterval samples through addChangePoint,
+		// like a wrapper handing in sample accurate automation
+		bool changePoints;
+	};
+
+	static void addHeldChord(Events& events, double, juce::int64)
+	{
+		scenario::addChord(events, 0, 48, true);
+	}
+
+	static const Scenario Scenarios[] =
+	{
+		{ "mpe-12-chords", xen::Mode::MPE, 12.f, false, scenario::addChords, false, false },
+		{ "mpe-19-trills", xen::Mode::MPE, 19.f, false, scenario::addTrills, false, false },
+		{ "mpe-12-lfo", xen::Mode::MPE, 12.f, true, scenario::addChords, false, false },
+		{ "mpe-sweep", xen::Mode::MPE, 12.f, false, addHeldChord, true, false },
+		{ "mpe-sweep-points", xen::Mode::MPE, 12.f, false, scenario::addChords, false, true },
+		{ "mts-31-chords", xen::Mode::MTSESP, 31.f, false, scenario::addChords, false, false },
+		{ "mts-sweep", xen::Mode::MTSESP, 12.f, false, addHeldChord, true, false },
+		{ "sysex-17-chords", xen::Mode::SysEx, 17.f, false, scenario::addChords, false, false }
+	};
+
+	static File getAudioFile(const File& dir, const Scenario& s)
+	{
+		return dir.getChildFile(String(s.name) + ".audio");
+	}
+
+	static File getMidiFile(const File& dir, const Scenario& s)
+	{
+		return dir.getChildFile(String(s.name) + ".midi.txt");
+	}
+
+	static File getTuningFile(const File& dir, const Scenario& s)
+	{
+		return dir.getChildFile(String(s.name) + ".tuning.txt");
+	}
+
+	// scenario, audio, midi, tuning
+	static void renderScenario(const Scenario& s, juce::AudioBuffer<float>& audio,
+		StringArray& midiLines, StringArray& tuningLines)
+	{
+		XenAudioProcessor processor;
+		scenario::setParameter(processor, "mode", static_cast<float>(static_cast<int>(s.mode)));
+		scenario::setParameter(processor, "xensnap", s.sweep || s.changePoints ? 0.f : 1.f);
+		scenario::setParameter(processor, "xen", s.xen);
+		if (s.lfo)
+		{
+			scenario::setParameter(processor, "modtype", 1.f);
+			scenario::setParameter(processor, "modrate", 3.f);
+			scenario::setParameter(processor, "modxen", 2.f);
+		}
+
+		const auto numSamples = static_cast<juce::int64>(Seconds * SampleRate);
+		Events events;
+		s.generate(events, SampleRate, numSamples);
+		audio.setSize(2, static_cast<int>(numSamples));
+		audio.clear();
+
+		const auto maxBlockSize = *std::max_element(std::begin(BlockSizes), std::end(BlockSizes));
+		processor.setRateAndBufferSizeDetails(SampleRate, maxBlockSize);
+		// full quality no matter how long a block takes, so renders are reproducible
+		processor.setNonRealtime(true);
+		processor.prepareToPlay(SampleRate, maxBlockSize);
+		juce::AudioBuffer<float> buffer(2, maxBlockSize);
+		juce::MidiBuffer midi;
+		size_t next = 0;
+		auto blockIdx = 0;
+		for (juce::int64 pos = 0; pos < numSamples; ++blockIdx)
+		{
+			const auto blockSize = static_cast<int>(juce::jmin(static_cast<juce::int64>(BlockSizes[blockIdx % std::size(BlockSizes)]), numSamples - pos));
+			midi.clear();
+			scenario::fillBlock(events, pos, blockSize, next, midi);
+			if (s.sweep)
+			{
+				const auto phase = static_cast<double>(pos) / SampleRate * math::Tau * .5;
+				scenario::setParameter(processor, "xen", static_cast<float>(12. + 7. * std::sin(phase)));
+			}
+			// on the thread that calls processBlock, right before it, as addChangePoint requires
+			if (s.changePoints)
+			{
+				auto parameters = processor.getXenParameters();
+				for (auto offset = 0; offset < blockSize; offset += ChangePointInterval)
+				{
+					const auto phase = static_cast<double>(pos + offset) / SampleRate * math::Tau * .5;
+					parameters.xen = 12. + 7. * std::sin(phase);
+					processor.addChangePoint(offset, parameters);
+				}
+			}
+			buffer.setSize(2, blockSize, false, false, true);
+			buffer.clear();
+			processor.processBlock(buffer, midi);
+			// no message loop runs the timer here, so beat for the tuning bus after every block,
+			// the clients never see the owner as gone however slow the render is
+			processor.xenProcessor.checkTuningBus();
+
+			for (auto ch = 0; ch < 2; ++ch)
+				audio.copyFrom(ch, static_cast<int>(pos), buffer, ch, 0, blockSize);
+			for (const auto it : midi)
+			{
+				String line(pos + it.samplePosition);
+				for (auto i = 0; i < it.numBytes; ++i)
+					line << " " << String::toHexString(it.data[i]).paddedLeft('0', 2);
+				midiLines.add(line);
+			}
+			pos += blockSize;
+		}
+
+		if (s.mode == xen::Mode::MTSESP)
+		{
+			// what any client sees while the processor is master, so this also covers publishing
+			auto client = MTS_RegisterClient();
+			double freqs[NumPitches];
+			MTS_NoteToFrequencies(client, freqs, static_cast<char>(-1));
+			MTS_DeregisterClient(client);
+			for (const auto freq : freqs)
+				tuningLines.add(String(freq, 9));
+		}
+		processor.releaseResources();
+	}
+
+	static bool writeAudio(const File& file, const juce::AudioBuffer<float>& audio)
+	{
+		file.deleteFile();
+		juce::FileOutputStream out(file);
+		if (!out.openedOk())
+			return false;
+		out.writeInt(AudioMagic);
+		out.writeInt(static_cast<int>(SampleRate));
+		out.writeInt(audio.getNumChannels());
+		out.writeInt(audio.getNumSamples());
+		for (auto ch = 0; ch < audio.getNumChannels(); ++ch)
+			out.write(audio.getReadPointer(ch), sizeof(float) * static_cast<size_t>(audio.getNumSamples()));
+		out.flush();
+		return out.getStatus().wasOk();
+	}
+
+	static bool readAudio(const File& file, juce::AudioBuffer<float>& audio)
+	{
+		juce::FileInputStream in(file);
+		if (!in.openedOk() || in.readInt() != AudioMagic)
+			return false;
+		in.readInt();
+		const auto numChannels = in.readInt();
+		const auto numSamples = in.readInt();
+		const auto numBytes = sizeof(float) * static_cast<size_t>(juce::jmax(0, numSamples));
+		if (numChannels < 1 || numSamples < 0 || in.getNumBytesRemaining() != static_cast<juce::int64>(numBytes) * numChannels)
+			return false;
+		audio.setSize(numChannels, numSamples);
+		for (auto ch = 0; ch < numChannels; ++ch)
+			in.read(audio.getWritePointer(ch), static_cast<int>(numBytes));
+		return true;
+	}
+
+	bool renderAll(const File& dir)
+	{
+		if (dir.createDirectory().failed())
+			return false;
+		for (const auto& s : Scenarios)
+		{
+			juce::AudioBuffer<float> audio;
+			StringArray midiLines, tuningLines;
+			renderScenario(s, audio, midiLines, tuningLines);
+			if (!writeAudio(getAudioFile(dir, s), audio) ||
+				!getMidiFile(dir, s).replaceWithText(midiLines.joinIntoString("\n")))
+				return false;
+			if (!tuningLines.isEmpty() && !getTuningFile(dir, s).replaceWithText(tuningLines.joinIntoString("\n")))
+				return false;
+		}
+		return true;
+	}
+
+	// reference, actual, tolerances, report
+	static bool compareAudio(const File& reference, const File& actual, const Tolerances& tolerances, StringArray& report)
+	{
+		juce::AudioBuffer<float> ref, act;
+		if (!readAudio(reference, ref) || !readAudio(actual, act))
+		{
+			report.add(actual.getFileName() + ": missing or unreadable");
+			return false;
+		}
+		if (ref.getNumChannels() != act.getNumChannels() || ref.getNumSamples() != act.getNumSamples())
+		{
+			report.add(actual.getFileName() + ": length or channel count differs");
+			return false;
+		}
+		double refEnergy = 0., diffEnergy = 0.;
+		for (auto ch = 0; ch < ref.getNumChannels(); ++ch)
+			for (auto i = 0; i < ref.getNumSamples(); ++i)
+			{
+				const auto r = static_cast<double>(ref.getSample(ch, i));
+				const auto d = static_cast<double>(act.getSample(ch, i)) - r;
+				refEnergy += r * r;
+				diffEnergy += d * d;
+			}
+		// relative to full scale if the reference is silent
+		const auto normEnergy = refEnergy > 0. ? refEnergy : static_cast<double>(ref.getNumSamples());
+		const auto diffDb = diffEnergy == 0. ? -300. : 10. * std::log10(diffEnergy / normEnergy);
+		const auto isOk = diffDb <= tolerances.maxDiffDb;
+		report.add(actual.getFileName() + ": difference " + String(diffDb, 1) + " dB" + (isOk ? "" : " FAILED"));
+		return isOk;
+	}
+
+	// reference, actual, report
+	static bool compareMidi(const File& reference, const File& actual, StringArray& report)
+	{
+		StringArray ref, act;
+		ref.addLines(reference.loadFileAsString());
+		act.addLines(actual.loadFileAsString());
+		for (auto i = 0; i < juce::jmax(ref.size(), act.size()); ++i)
+			if (ref[i] != act[i])
+			{
+				report.add(actual.getFileName() + ": line " + String(i + 1) + " is \"" + act[i] +
+					"\", expected \"" + ref[i] + "\" FAILED");
+				return false;
+			}
+		report.add(actual.getFileName() + ": " + String(ref.size()) + " events match");
+		return true;
+	}
+
+	// reference, actual, tolerances, report
+	static bool compareTuning(const File& reference, const File& actual, const Tolerances& tolerances, StringArray& report)
+	{
+		StringArray ref, act;
+		ref.addLines(reference.loadFileAsString());
+		act.addLines(actual.loadFileAsString());
+		if (ref.size() != NumPitches || act.size() != NumPitches)
+		{
+			report.add(actual.getFileName() + ": missing or unreadable");
+			return false;
+		}
+		auto maxCents = 0.;
+		for (auto i = 0; i < NumPitches; ++i)
+		{
+			const auto r = ref[i].getDoubleValue();
+			const auto a = act[i].getDoubleValue();
+			const auto cents = r > 0. && a > 0. ? std::abs(1200. * std::log2(a / r)) : 1200.;
+			maxCents = juce::jmax(maxCents, cents);
+		}
+		const auto isOk = maxCents <= tolerances.maxCents;
+		report.add(actual.getFileName() + ": max deviation " + String(maxCents, 4) + " cents" + (isOk ? "" : " FAILED"));
+		return isOk;
+	}
+
+	bool compare(const File& reference, const File& actual, const Tolerances& tolerances, StringArray& report)
+	{
+		auto isOk = true;
+		for (const auto& s : Scenarios)
+		{
+			isOk = compareAudio(getAudioFile(reference, s), getAudioFile(actual, s), tolerances, report) && isOk;
+			isOk = compareMidi(getMidiFile(reference, s), getMidiFile(actual, s), report) && isOk;
+			if (s.mode == xen::Mode::MTSESP)
+				isOk = compareTuning(getTuningFile(reference, s), getTuningFile(actual, s), tolerances, report) && isOk;
+		}
+		return isOk;
+	}
+}
\ No newline at end of file
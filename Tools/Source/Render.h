@@ -0,0 +1,30 @@
+#pragma once
+#include <JuceHeader.h>
+
+namespace render
+{
+	using File = juce::File;
+	using StringArray = juce::StringArray;
+
+	struct Tolerances
+	{
+		Tolerances() :
+			maxDiffDb(-80.),
+			maxCents(.01)
+		{}
+
+		// energy of the difference relative to the reference's
+		double maxDiffDb;
+		// per note of the mts tuning table
+		double maxCents;
+	};
+
+	// dir
+	// renders every scenario into dir: audio, the midi output as text
+	// and, in mts-esp mode, the tuning a client sees afterwards
+	bool renderAll(const File&);
+
+	// reference, actual, tolerances, report
+	// midi has to match exactly, audio and tuning within the tolerances
+	bool compare(const File&, const File&, const Tolerances&, StringArray&);
+}
\ No newline at end of file
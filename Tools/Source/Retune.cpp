@@ -0,0 +1,269 @@
+#include "Retune.h"
+#include "../../Source/AutoMPE.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace retune
+{
+	using MidiBuffer = juce::MidiBuffer;
+
+	static constexpr int NumPitches = xen::Xen::NumPitches;
+	// queued files per worker, bounds memory while the directory is still being scanned
+	static constexpr int QueuedPerWorker = 64;
+	static constexpr int MaxErrors = 100;
+
+	// one deque per worker: the owner takes from the front, idle workers steal from
+	// the back of the others', so a few large files don't leave the other cores idle
+	class WorkQueue
+	{
+		struct Deque
+		{
+			std::mutex mutex;
+			std::deque<File> files;
+		};
+	public:
+		WorkQueue(int numWorkers) :
+			deques(),
+			mutex(),
+			workAdded(),
+			workTaken(),
+			numQueued(0),
+			capacity(numWorkers * QueuedPerWorker),
+			closed(false)
+		{
+			for (auto i = 0; i < numWorkers; ++i)
+				deques.push_back(std::make_unique<Deque>());
+		}
+
+		// file, worker
+		// blocks while the queue is full
+		void push(const File& file, int worker)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				workTaken.wait(lock, [this]() { return numQueued < capacity; });
+			}
+			{
+				const std::lock_guard<std::mutex> lock(deques[worker]->mutex);
+				deques[worker]->files.push_back(file);
+			}
+			{
+				const std::lock_guard<std::mutex> lock(mutex);
+				++numQueued;
+			}
+			workAdded.notify_one();
+		}
+
+		// no more files will be pushed
+		void close()
+		{
+			{
+				const std::lock_guard<std::mutex> lock(mutex);
+				closed = true;
+			}
+			workAdded.notify_all();
+		}
+
+		// worker, file
+		// false once the queue is closed and empty
+		bool pop(int worker, File& file)
+		{
+			for (;;)
+			{
+				if (take(worker, file))
+				{
+					{
+						const std::lock_guard<std::mutex> lock(mutex);
+						--numQueued;
+					}
+					workTaken.notify_one();
+					return true;
+				}
+				std::unique_lock<std::mutex> lock(mutex);
+				if (numQueued == 0 && closed)
+					return false;
+				workAdded.wait(lock, [this]() { return numQueued > 0 || closed; });
+			}
+		}
+
+	private:
+		std::vector<std::unique_ptr<Deque>> deques;
+		std::mutex mutex;
+		std::condition_variable workAdded, workTaken;
+		int numQueued, capacity;
+		bool closed;
+
+		bool take(int worker, File& file)
+		{
+			const auto numDeques = static_cast<int>(deques.size());
+			for (auto i = 0; i < numDeques; ++i)
+			{
+				auto& deque = *deques[(worker + i) % numDeques];
+				const std::lock_guard<std::mutex> lock(deque.mutex);
+				if (deque.files.empty())
+					continue;
+				if (i == 0)
+				{
+					file = deque.files.front();
+					deque.files.pop_front();
+				}
+				else
+				{
+					file = deque.files.back();
+					deque.files.pop_back();
+				}
+				return true;
+			}
+			return false;
+		}
+	};
+
+	void fillFreqTable(const Settings& settings, double* table)
+	{
+		xen::Xen::fillFreqTable(table, settings.xen, settings.anchorFreq, settings.stepsIn12,
+			settings.hasScale ? &settings.scale : nullptr, simd::getKernels());
+	}
+
+	// settings, freqTable, midi, numTicks
+	static void processMPE(const Settings& settings, const double* table, MidiBuffer& midi, int numTicks)
+	{
+		mpe::AutoMPE autoMPE;
+		mpe::Split split;
+		xen::XenRescalerMPE rescaler(split);
+		rescaler.update(settings.pbRange);
+		autoMPE(midi);
+		split(midi);
+		rescaler(midi, table, numTicks);
+	}
+
+	// settings, freqTable, midi, numTicks
+	// like the plugin in sysex mode, the notes pass unchanged and the receiver is retuned
+	static void processSysex(const Settings& settings, const double* table, MidiBuffer& midi, int numTicks)
+	{
+		const auto name = settings.hasScale ? settings.scale.name : String(settings.xen, 2) + " tet";
+		auto sysex = std::make_unique<xen::MTSSysex>();
+		sysex->compile(table, name.toRawUTF8());
+		sysex->begin();
+		sysex->emit(0);
+		// the dump goes before everything else at tick 0
+		MidiBuffer out;
+		sysex->end(out, numTicks);
+		out.addEvents(midi, 0, -1, 0);
+		midi.swapWith(out);
+	}
+
+	bool retuneFile(const File& in, const File& out, const Settings& settings, const double* table, String& error)
+	{
+		juce::MidiFile midiFile;
+		{
+			juce::FileInputStream stream(in);
+			if (!stream.openedOk() || !midiFile.readFrom(stream))
+			{
+				error = "not a readable midi file";
+				return false;
+			}
+		}
+
+		// ticks are kept as they are, so the midi processing sees them as sample positions
+		MidiBuffer midi;
+		auto numTicks = 1;
+		for (auto t = 0; t < midiFile.getNumTracks(); ++t)
+			for (const auto holder : *midiFile.getTrack(t))
+			{
+				const auto tick = static_cast<int>(juce::jlimit(0., static_cast<double>(std::numeric_limits<int>::max() - 1), holder->message.getTimeStamp()));
+				if (holder->message.isEndOfTrackMetaEvent())
+					continue;
+				midi.addEvent(holder->message, tick);
+				numTicks = juce::jmax(numTicks, tick + 1);
+			}
+
+		if (settings.mode == xen::Mode::SysEx)
+			processSysex(settings, table, midi, numTicks);
+		else
+			processMPE(settings, table, midi, numTicks);
+
+		juce::MidiMessageSequence track;
+		for (const auto it : midi)
+			track.addEvent(it.getMessage(), static_cast<double>(it.samplePosition));
+		juce::MidiFile result;
+		const auto timeFormat = midiFile.getTimeFormat();
+		if (timeFormat > 0)
+			result.setTicksPerQuarterNote(timeFormat);
+		else
+			result.setSmpteTimeFormat(-(timeFormat >> 8), timeFormat & 0xff);
+		result.addTrack(track);
+
+		if (out.getParentDirectory().createDirectory().failed())
+		{
+			error = "could not create " + out.getParentDirectory().getFullPathName();
+			return false;
+		}
+		juce::TemporaryFile temp(out);
+		{
+			juce::FileOutputStream stream(temp.getFile());
+			if (!stream.openedOk() || !result.writeTo(stream))
+			{
+				error = "could not write " + out.getFullPathName();
+				return false;
+			}
+		}
+		if (!temp.overwriteTargetFileWithTemporary())
+		{
+			error = "could not replace " + out.getFullPathName();
+			return false;
+		}
+		return true;
+	}
+
+	Result retuneAll(const File& inDir, const File& outDir, const Settings& settings)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		double table[NumPitches];
+		fillFreqTable(settings, table);
+
+		const auto numWorkers = juce::jmax(1, settings.numThreads);
+		WorkQueue queue(numWorkers);
+		std::atomic<int> numFiles(0), numFailed(0);
+		std::mutex errorMutex;
+		juce::StringArray errors;
+
+		std::vector<std::thread> workers;
+		for (auto w = 0; w < numWorkers; ++w)
+			workers.emplace_back([&, w]()
+			{
+				File in;
+				while (queue.pop(w, in))
+				{
+					const auto out = outDir.getChildFile(in.getRelativePathFrom(inDir));
+					String error;
+					++numFiles;
+					if (retuneFile(in, out, settings, table, error))
+						continue;
+					++numFailed;
+					const std::lock_guard<std::mutex> lock(errorMutex);
+					if (errors.size() < MaxErrors)
+						errors.add(in.getFullPathName() + ": " + error);
+				}
+			});
+
+		auto next = 0;
+		for (const auto& entry : juce::RangedDirectoryIterator(inDir, true, "*.mid;*.midi", File::findFiles))
+		{
+			queue.push(entry.getFile(), next);
+			next = (next + 1) % numWorkers;
+		}
+		queue.close();
+		for (auto& worker : workers)
+			worker.join();
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		return { numFiles.load(), numFailed.load(), std::chrono::duration<double>(elapsed).count(), errors };
+	}
+}
\ No newline at end of file
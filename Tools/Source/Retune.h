@@ -0,0 +1,55 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../../Source/Xen.h"
+
+// offline retuning of midi files with the plugin's own midi processing
+namespace retune
+{
+	using File = juce::File;
+	using String = juce::String;
+
+	struct Settings
+	{
+		Settings() :
+			mode(xen::Mode::MPE),
+			xen(12.),
+			anchorFreq(440.),
+			pbRange(48.),
+			stepsIn12(false),
+			scale(),
+			hasScale(false),
+			numThreads(juce::SystemStats::getNumCpus())
+		{}
+
+		// mpe: notes are spread over channels 2-16 with pitch bends,
+		// sysex: the notes stay, a bulk dump in front retunes the receiver
+		xen::Mode mode;
+		double xen, anchorFreq, pbRange;
+		bool stepsIn12;
+		// replaces xen if hasScale, like the scale parameter
+		scala::Scale scale;
+		bool hasScale;
+		int numThreads;
+	};
+
+	struct Result
+	{
+		int numFiles, numFailed;
+		double seconds;
+		// the first failures, with their reason
+		juce::StringArray errors;
+	};
+
+	// inDir, outDir, settings
+	// retunes every .mid/.midi file below inDir into the same relative path below outDir.
+	// files are found while the first ones are already being processed, so memory
+	// stays flat no matter how large the directory is
+	Result retuneAll(const File&, const File&, const Settings&);
+
+	// in, out, settings, freqTable, error
+	bool retuneFile(const File&, const File&, const Settings&, const double*, String&);
+
+	// settings, freqTable
+	// the same table the plugin would use with these parameters
+	void fillFreqTable(const Settings&, double*);
+}
\ No newline at end of file
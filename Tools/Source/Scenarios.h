@@ -0,0 +1,78 @@
+#pragma once
+#include <JuceHeader.h>
+#include <vector>
+#include "../../Source/PluginProcessor.h"
+
+// deterministic midi input and parameter helpers shared by the tools
+namespace scenario
+{
+	using MidiMessage = juce::MidiMessage;
+	using String = juce::String;
+
+	struct Event
+	{
+		juce::int64 time;
+		MidiMessage msg;
+	};
+
+	using Events = std::vector<Event>;
+
+	// events, time, root, noteOn
+	inline void addChord(Events& events, juce::int64 time, int root, bool noteOn)
+	{
+		for (const auto interval : { 0, 4, 7, 11 })
+		{
+			const auto note = root + interval;
+			events.push_back({ time, noteOn ?
+				MidiMessage::noteOn(1, note, static_cast<juce::uint8>(100)) :
+				MidiMessage::noteOff(1, note) });
+		}
+	}
+
+	// events, sampleRate, numSamples
+	// a new chord every half second, always 4 notes held
+	inline void addChords(Events& events, double sampleRate, juce::int64 numSamples)
+	{
+		const auto interval = static_cast<juce::int64>(sampleRate * .5);
+		auto root = 48;
+		for (juce::int64 t = 0; t < numSamples; t += interval)
+		{
+			if (t != 0)
+				addChord(events, t, root, false);
+			root = 48 + (root - 48 + 5) % 12;
+			addChord(events, t, root, true);
+		}
+	}
+
+	// events, sampleRate, numSamples
+	// two notes alternating every 2ms
+	inline void addTrills(Events& events, double sampleRate, juce::int64 numSamples)
+	{
+		const auto interval = juce::jmax(static_cast<juce::int64>(1), static_cast<juce::int64>(sampleRate * .002));
+		auto note = 60;
+		for (juce::int64 t = 0; t < numSamples; t += interval)
+		{
+			if (t != 0)
+				events.push_back({ t, MidiMessage::noteOff(1, note) });
+			note = note == 60 ? 62 : 60;
+			events.push_back({ t, MidiMessage::noteOn(1, note, static_cast<juce::uint8>(100)) });
+		}
+	}
+
+	// events, pos, blockSize, next, midi
+	// moves the events of [pos, pos + blockSize[ into midi, returns how many
+	inline int fillBlock(const Events& events, juce::int64 pos, int blockSize, size_t& next, juce::MidiBuffer& midi)
+	{
+		auto numEvents = 0;
+		for (; next < events.size() && events[next].time < pos + blockSize; ++next, ++numEvents)
+			midi.addEvent(events[next].msg, static_cast<int>(events[next].time - pos));
+		return numEvents;
+	}
+
+	// processor, id, denormalised value
+	inline void setParameter(XenAudioProcessor& processor, const String& id, float value)
+	{
+		auto parameter = processor.apvts.getParameter(id);
+		parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+	}
+}
\ No newline at end of file
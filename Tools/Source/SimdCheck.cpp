@@ -0,0 +1,173 @@
+#include "SimdCheck.h"
+#include "Benchmark.h"
+#include "../../Source/Axiom.h"
+#include "../../Source/Math.h"
+#include "../../Source/Simd.h"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <cmath>
+#include <vector>
+
+namespace simdcheck
+{
+	using Clock = std::chrono::steady_clock;
+	using Kernels = simd::Kernels;
+
+	// the output is float: one ulp of the loudest sample
+	static constexpr double OscTolerance = 1e-7;
+	// relative, 1.7e-9 cents
+	static constexpr double Exp2Tolerance = 1e-12;
+	static constexpr int NumSamples = 1 << 16;
+	static constexpr int NumPitches = 128;
+	// the kernel's range, minus what the scale of 440 takes
+	static constexpr double MinExponent = -1022.;
+	static constexpr double MaxExponent = 1014.;
+
+	struct Input
+	{
+		std::vector<double> phases, envs, exponents;
+	};
+
+	// phases over [-pi, pi] including both ends, envelopes over [0, 1] and the
+	// exponents of every edo's table, plus a sweep over what scales can reach
+	static Input makeInput()
+	{
+		Input input;
+		juce::Random random(1234);
+		for (auto i = 0; i < NumSamples; ++i)
+		{
+			const auto x = static_cast<double>(i) / static_cast<double>(NumSamples - 1);
+			input.phases.push_back(-math::Pi + math::Tau * x);
+			input.envs.push_back(random.nextDouble());
+		}
+		for (auto xen = axiom::MinXen; xen <= axiom::MaxXen; ++xen)
+			for (auto i = 0; i < NumPitches; ++i)
+				input.exponents.push_back((static_cast<double>(i) - 69.) / static_cast<double>(xen));
+		for (auto i = 0; i < NumSamples; ++i)
+			input.exponents.push_back(MinExponent + (MaxExponent - MinExponent) * random.nextDouble());
+		return input;
+	}
+
+	// maxError, error
+	// keeps nan, so that it fails the check
+	static double getMaxError(double maxError, double error) noexcept
+	{
+		return std::isnan(maxError) || error <= maxError ? maxError : error;
+	}
+
+	struct Output
+	{
+		std::vector<float> osc, sine;
+		std::vector<double> exp2;
+	};
+
+	// kernels, input, output
+	static void process(const Kernels& kernels, const Input& input, Output& output)
+	{
+		const auto numSamples = static_cast<int>(input.phases.size());
+		output.osc.assign(input.phases.size(), 0.f);
+		output.sine.assign(input.phases.size(), 0.f);
+		output.exp2.resize(input.exponents.size());
+		kernels.osc(output.osc.data(), input.phases.data(), input.envs.data(), 4., .2, numSamples);
+		kernels.sine(output.sine.data(), input.phases.data(), input.envs.data(), .2, numSamples);
+		kernels.exp2(output.exp2.data(), input.exponents.data(), 440., static_cast<int>(output.exp2.size()));
+	}
+
+	// a, b
+	static double getMaxError(const std::vector<float>& a, const std::vector<float>& b) noexcept
+	{
+		auto maxError = 0.;
+		for (size_t i = 0; i < a.size(); ++i)
+			maxError = getMaxError(maxError, std::abs(static_cast<double>(a[i]) - static_cast<double>(b[i])));
+		return maxError;
+	}
+
+	// func, numValues, numRuns
+	// fastest run, in ns per value
+	template<typename Func>
+	static double time(const Func& func, size_t numValues, int numRuns)
+	{
+		auto best = 0.;
+		for (auto r = 0; r < numRuns; ++r)
+		{
+			const auto start = Clock::now();
+			func();
+			const auto ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+			best = r == 0 ? ns : juce::jmin(best, ns);
+		}
+		return best / static_cast<double>(numValues);
+	}
+
+	juce::var run(int numRuns)
+	{
+		const auto input = makeInput();
+		Output ref, out;
+		process(simd::getKernels(simd::Path::Scalar), input, ref);
+
+		juce::Array<juce::var> results;
+		auto passed = true;
+		// osc, sine and exp2 of the scalar path, the speedups are relative to it
+		double scalarNs[3] = {};
+		for (auto p = 0; p < simd::NumPaths; ++p)
+		{
+			const auto path = static_cast<simd::Path>(p);
+			auto result = new juce::DynamicObject();
+			result->setProperty("path", simd::getName(path));
+			result->setProperty("supported", simd::isSupported(path));
+			results.add(result);
+			if (!simd::isSupported(path))
+				continue;
+
+			const auto& kernels = simd::getKernels(path);
+			process(kernels, input, out);
+			const auto oscError = getMaxError(out.osc, ref.osc);
+			const auto sineError = getMaxError(out.sine, ref.sine);
+			auto exp2Error = 0.;
+			for (size_t i = 0; i < out.exp2.size(); ++i)
+				exp2Error = getMaxError(exp2Error, std::abs(out.exp2[i] / ref.exp2[i] - 1.));
+			const auto isPassed = oscError <= OscTolerance && sineError <= OscTolerance && exp2Error <= Exp2Tolerance;
+			passed = passed && isPassed;
+
+			const auto numSamples = static_cast<int>(input.phases.size());
+			result->setProperty("oscMaxError", oscError);
+			result->setProperty("sineMaxError", sineError);
+			result->setProperty("exp2MaxRelativeError", exp2Error);
+			result->setProperty("passed", isPassed);
+			const double ns[] =
+			{
+				time([&]()
+				{
+					kernels.osc(out.osc.data(), input.phases.data(), input.envs.data(), 4., .2, numSamples);
+				}, out.osc.size(), numRuns),
+				time([&]()
+				{
+					kernels.sine(out.sine.data(), input.phases.data(), input.envs.data(), .2, numSamples);
+				}, out.sine.size(), numRuns),
+				time([&]()
+				{
+					kernels.exp2(out.exp2.data(), input.exponents.data(), 440., static_cast<int>(out.exp2.size()));
+				}, out.exp2.size(), numRuns)
+			};
+			// the scalar path comes first
+			if (path == simd::Path::Scalar)
+				std::copy(std::begin(ns), std::end(ns), std::begin(scalarNs));
+			result->setProperty("oscNsPerSample", ns[0]);
+			result->setProperty("sineNsPerSample", ns[1]);
+			result->setProperty("exp2NsPerValue", ns[2]);
+			result->setProperty("oscSpeedup", scalarNs[0] / ns[0]);
+			result->setProperty("sineSpeedup", scalarNs[1] / ns[1]);
+			result->setProperty("exp2Speedup", scalarNs[2] / ns[2]);
+		}
+
+		auto report = new juce::DynamicObject();
+		report->setProperty("machine", bench::getMachineInfo());
+		report->setProperty("selected", simd::getName(simd::getKernels().path));
+		report->setProperty("forced", XEN_SIMD);
+		report->setProperty("oscTolerance", OscTolerance);
+		report->setProperty("exp2Tolerance", Exp2Tolerance);
+		report->setProperty("passed", passed);
+		report->setProperty("results", results);
+		return report;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+#include <JuceHeader.h>
+
+// cross-checks the vectorised kernels of every path this cpu supports against the scalar path
+namespace simdcheck
+{
+	// numRuns
+	// per path: the largest deviation from the scalar path, ns per value and the speedup over the scalar path.
+	// "passed" is false if any path is off by more than the tolerances in the report
+	juce::var run(int);
+}
\ No newline at end of file